@@ -0,0 +1,78 @@
+#include "Alloc_Counter.h"
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+#ifdef SHELL_COUNT_ALLOCATIONS
+
+// Plain and array new go through malloc, so the matching deletes free; the aligned forms keep the library's versions,
+// which never meet these deletes
+static long long allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size != 0 ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    allocations++;
+    return malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+bool Alloc_Counter::isEnabled()
+{
+    return true;
+}
+
+long long Alloc_Counter::getCount()
+{
+    return allocations;
+}
+
+#else
+
+bool Alloc_Counter::isEnabled()
+{
+    return false;
+}
+
+long long Alloc_Counter::getCount()
+{
+    return 0;
+}
+
+#endif
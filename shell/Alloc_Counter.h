@@ -0,0 +1,16 @@
+#pragma once
+using namespace std;
+
+/** Counts heap allocations in a build with SHELL_COUNT_ALLOCATIONS defined, where the global operator new is replaced
+    by a counting one; the shell then reports how many allocations each command made, and shell --check-allocations
+    fails when a read-only command allocates on a warm cache (the AllocCheck configuration runs it after every build).
+    Without the define nothing is replaced and the count stays 0. */
+class Alloc_Counter
+{
+public:
+    /** Returns true in a counting build. */
+    static bool isEnabled();
+
+    /** Number of allocations made through operator new since the program started. */
+    static long long getCount();
+};
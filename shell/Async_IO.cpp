@@ -0,0 +1,240 @@
+#include "Async_IO.h"
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+
+// The ring is driven with the raw system calls, so no extra library is needed
+namespace
+{
+    /** One queued request, remembered so a short read can be zero-filled and a short write reported. */
+    struct Request
+    {
+        char* buffer;
+        size_t size;
+        bool isRead;
+    };
+
+    int ringFd = -1;
+    int targetFd = -1;
+
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    Request requests[Async_IO::QUEUE_DEPTH];
+    unsigned queued = 0;
+    bool failed = false;
+
+    unsigned loadAcquire(unsigned* p)
+    {
+        return atomic_ref<unsigned>(*p).load(memory_order_acquire);
+    }
+
+    void storeRelease(unsigned* p, unsigned value)
+    {
+        atomic_ref<unsigned>(*p).store(value, memory_order_release);
+    }
+
+    void queue(unsigned char opcode, char* buffer, size_t size, long long offset, bool isRead)
+    {
+        // A full queue is flushed before the next request is added
+        if (queued == Async_IO::QUEUE_DEPTH || queued == sqEntries)
+            failed = !Async_IO::submitAndWait() || failed;
+
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = targetFd;
+        sqe->addr = reinterpret_cast<unsigned long long>(buffer);
+        sqe->len = static_cast<unsigned>(size);
+        sqe->off = static_cast<unsigned long long>(offset);
+        sqe->user_data = queued;
+        sqArray[index] = index;
+
+        requests[queued] = { buffer, size, isRead };
+        queued++;
+        storeRelease(sqTail, tail + 1);
+    }
+}
+
+bool Async_IO::open(int fileDescriptor)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+    if (fd < 0)
+        return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    cqRing = singleMmap ? sqRing
+        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqeMemory == MAP_FAILED) {
+        if (cqRing != MAP_FAILED && !singleMmap)
+            munmap(cqRing, cqRingSize);
+        if (sqeMemory != MAP_FAILED)
+            munmap(sqeMemory, sqesSize);
+        munmap(sqRing, sqRingSize);
+        ::close(fd);
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+    ringFd = fd;
+    targetFd = fileDescriptor;
+    queued = 0;
+    failed = false;
+    return true;
+}
+
+bool Async_IO::isAvailable()
+{
+    return ringFd >= 0;
+}
+
+void Async_IO::queueRead(char* out, size_t size, long long offset)
+{
+    queue(IORING_OP_READ, out, size, offset, true);
+}
+
+void Async_IO::queueWrite(const char* data, size_t size, long long offset)
+{
+    queue(IORING_OP_WRITE, const_cast<char*>(data), size, offset, false);
+}
+
+bool Async_IO::submitAndWait()
+{
+    unsigned toComplete = queued;
+    queued = 0;
+
+    // One system call submits the whole batch and waits for all of it
+    unsigned completed = 0;
+    unsigned toSubmit = toComplete;
+    while (completed < toComplete)
+    {
+        long result = syscall(__NR_io_uring_enter, ringFd, toSubmit, toComplete - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (result < 0 && errno != EINTR) {
+            failed = true;
+            break;
+        }
+        if (result > 0)
+            toSubmit -= min(toSubmit, static_cast<unsigned>(result));
+
+        unsigned head = *cqHead;
+        unsigned tail = loadAcquire(cqTail);
+        for (; head != tail; head++, completed++)
+        {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            const Request& request = requests[cqe.user_data];
+            if (cqe.res < 0)
+                failed = true;
+            else if (static_cast<size_t>(cqe.res) < request.size)
+            {
+                // Reading past the end of the file is not an error: the missing part is zeros
+                if (request.isRead)
+                    memset(request.buffer + cqe.res, 0, request.size - cqe.res);
+                else
+                    failed = true;
+            }
+        }
+        storeRelease(cqHead, head);
+    }
+
+    bool ok = !failed;
+    failed = false;
+    return ok;
+}
+
+void Async_IO::close()
+{
+    if (ringFd < 0)
+        return;
+
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+    ::close(ringFd);
+    ringFd = -1;
+    targetFd = -1;
+}
+
+#else
+
+// Without io_uring every caller stays on its synchronous path
+bool Async_IO::open(int)
+{
+    return false;
+}
+
+bool Async_IO::isAvailable()
+{
+    return false;
+}
+
+void Async_IO::queueRead(char*, size_t, long long)
+{
+}
+
+void Async_IO::queueWrite(const char*, size_t, long long)
+{
+}
+
+bool Async_IO::submitAndWait()
+{
+    return false;
+}
+
+void Async_IO::close()
+{
+}
+
+#endif
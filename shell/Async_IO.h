@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+using namespace std;
+
+/** Batches reads and writes on one file through Linux io_uring, so many cluster runs are in flight at once.
+    On other platforms, or when the kernel refuses io_uring, open() fails and callers use their synchronous path. */
+class Async_IO
+{
+public:
+    /** Number of requests that can be queued before the batch is submitted. */
+    static const unsigned QUEUE_DEPTH = 64;
+
+    /** Sets up the ring for the given file descriptor; returns false when io_uring is unavailable. */
+    static bool open(int fileDescriptor);
+
+    /** Returns true when the ring is set up. */
+    static bool isAvailable();
+
+    /** Queues a read of size bytes at offset into out; bytes past the end of the file read as zeros. */
+    static void queueRead(char* out, size_t size, long long offset);
+
+    /** Queues a write of size bytes from data at offset; data must stay valid until submitAndWait() returns. */
+    static void queueWrite(const char* data, size_t size, long long offset);
+
+    /** Submits everything queued and waits for it; returns false if any request failed since the last call. */
+    static bool submitAndWait();
+
+    /** Tears the ring down. */
+    static void close();
+};
@@ -0,0 +1,13 @@
+#pragma once
+using namespace std;
+
+/** Times the directory slot codec (shell --bench-codec): Converter::Directory_EntriesToBytes and
+    Converter::BytesToDirectory_Entries against the byte-by-byte codec they replaced, on a directory of a few thousand
+    entries. No disk is opened. The old codec is kept here only as the baseline of the timing; nothing else calls it. */
+class Codec_Bench
+{
+public:
+    /** Prints the time per entry of both codecs in each direction. Returns the exit status: 1 if the two codecs do not
+        produce the same bytes and entries. */
+    static int run();
+};
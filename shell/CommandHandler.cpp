@@ -1,4 +1,7 @@
+#include "Alloc_Counter.h"
 #include "Directory.h"
+#include "Dentry_Cache.h"
+#include "Journal.h"
 #include "Mini_FAT.h"
 #include "File_Entry.h"
 #include "Parser.h"
@@ -7,6 +10,7 @@
 #include <cstring>
 #include <cctype>
 #include <sstream>
+#include <string_view>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -147,6 +151,31 @@ CommandHandler::CommandHandler(Directory** currentDirPtr)
         "Examples:\n"
         "  - Export a file: `export virtualFile.txt /downloads`\n"
     };
+
+    // Transactions
+    commandHelp["begin"] = {
+        "Starts a transaction: later commands are kept in memory until commit.",
+        "Usage:\n"
+        "  begin\n\n"
+        "Examples:\n"
+        "  - Group many commands into one write: `begin`, then the commands, then `commit`\n"
+    };
+
+    commandHelp["commit"] = {
+        "Writes everything done since begin to the disk in one ordered flush.",
+        "Usage:\n"
+        "  commit\n\n"
+        "Examples:\n"
+        "  - Keep the changes: `commit`\n"
+    };
+
+    commandHelp["abort"] = {
+        "Discards everything done since begin.",
+        "Usage:\n"
+        "  abort\n\n"
+        "Examples:\n"
+        "  - Undo the changes: `abort`\n"
+    };
 }
 void CommandHandler::executeCommand(const string& input, bool& isRunning)
 {
@@ -173,6 +202,15 @@ void CommandHandler::executeCommand(const string& input, bool& isRunning)
         c = tolower(c);
     }
 
+    // A counting build reports the allocations of the command itself, after the line has been tokenized and parsed
+    long long allocationsBefore = Alloc_Counter::getCount();
+
+    // With a journal every command runs in a transaction of its own, so it reaches the disk as one journal record
+    // and a crash leaves either all of it or none; inside a user transaction the command is simply part of that one
+    bool commandTransaction = Journal::isEnabled() && !Virtual_Disk::isTransactionOpen();
+    if (commandTransaction)
+        Mini_FAT::beginTransaction();
+
     // Now, use cmd.name and cmd.arguments as before
     if (parsedcmd.name == "help")
     {
@@ -354,6 +392,26 @@ void CommandHandler::executeCommand(const string& input, bool& isRunning)
             processRd(parsedcmd.arguments);
         }
     }
+    else if (parsedcmd.name == "begin" || parsedcmd.name == "commit" || parsedcmd.name == "abort")
+    {
+        if (!parsedcmd.arguments.empty())
+        {
+            cout << "Error: Incorrect syntax for '" << parsedcmd.name << "' command.\n";
+            cout << "Usage: " << parsedcmd.name << "\n";
+        }
+        else if (parsedcmd.name == "begin")
+        {
+            processBegin();
+        }
+        else if (parsedcmd.name == "commit")
+        {
+            processCommit();
+        }
+        else
+        {
+            processAbort();
+        }
+    }
     else if (parsedcmd.name == "quit")
     {
         if (parsedcmd.arguments.empty())
@@ -370,6 +428,28 @@ void CommandHandler::executeCommand(const string& input, bool& isRunning)
     {
         cout << "Error: Unknown command '" << parsedcmd.name << "'. Type 'help' to see available commands.\n";
     }
+
+    // Write each directory cluster the command changed once, commit the FAT clusters it changed, then write back
+    // every dirty cluster with a single flush; inside a transaction all of this stays in memory until commit
+    Directory::flushAll();
+    if (commandTransaction && !userTransaction)
+        Mini_FAT::commitTransaction();
+    else
+    {
+        Mini_FAT::writeFAT();
+        Virtual_Disk::sync();
+    }
+
+    // No directory pointer but the current one outlives the command, so this is where the dentry cache is trimmed
+    Dentry_Cache::trim(*currentDirectoryPtr);
+
+    lastAllocations = Alloc_Counter::getCount() - allocationsBefore;
+    if (Alloc_Counter::isEnabled())
+        cout << "[" << parsedcmd.name << ": " << lastAllocations << " allocation(s)]\n";
+}
+long long CommandHandler::getLastAllocations() const
+{
+    return lastAllocations;
 }
 void CommandHandler::processAllCommandsHelp()
 {
@@ -472,58 +552,44 @@ void CommandHandler::processMd(const string& dirPath)
         return;
     }
 
-    // Step 4: Check for duplicate directory name
-    for (const auto& entry : parentDir->DirOrFiles)
-    {
-        if (!entry.getIsFile())
-        {
-            string existingName = entry.getName();
-            string newName = dirName;
-
-            // Normalize names for case-insensitive comparison
-            std::transform(existingName.begin(), existingName.end(), existingName.begin(),
-                [](unsigned char c) { return std::tolower(c); });
-            std::transform(newName.begin(), newName.end(), newName.begin(),
-                [](unsigned char c) { return std::tolower(c); });
-
-            if (existingName == newName)
-            {
-                cout << "Error: Directory '" << dirName << "' already exists.\n";
-                return;
-            }
-        }
-    }
-
-    // Step 5: Allocate a cluster for the new directory
-    int newCluster = Mini_FAT::getAvailableCluster();
-    if (newCluster == -1)
+    // Step 4: Check for duplicate directory name (the lookup is case-insensitive)
+    int existingIndex = parentDir->searchDirectory(dirName);
+    if (existingIndex != -1 && !parentDir->DirOrFiles[existingIndex].getIsFile())
     {
-        cout << "Error: No available clusters to create directory.\n";
+        cout << "Error: Directory '" << dirName << "' already exists.\n";
         return;
     }
 
-    // Step 6: Initialize and clean up the directory name
-    Mini_FAT::setClusterPointer(newCluster, -1); // Mark cluster as EOF
-    string cleanedName = Directory_Entry::cleanTheName(dirName);
+    // Step 5: Clean up the directory name before anything is allocated for it
+    string cleanedName(Directory_Entry::cleanTheName(dirName));
     if (cleanedName.empty())
     {
         cout << "Error: Invalid directory name.\n";
         return;
     }
 
-    // Step 7: Create the new directory
-    Directory* newDir = new Directory(cleanedName, 0x10, newCluster, parentDir);
-    newDir->readDirectory(); // Initialize with '.' and '..'
+    // Step 6: Allocate a cluster for the new directory near its parent's, so a walk down the tree stays close on disk;
+    // allocateChain marks it as the end of its chain
+    vector<int> chain = Mini_FAT::allocateChain(1, parentDir->dir_firstCluster);
+    if (chain.empty())
+    {
+        cout << "Error: No available clusters to create directory.\n";
+        return;
+    }
+    int newCluster = chain[0];
 
-    // Step 8: Create a Directory_Entry object for the new directory
+    // Step 7: Create a Directory_Entry object for the new directory; its Directory object is loaded by the dentry cache
+    // on first use, so the cluster is cleared first rather than left holding whatever was freed there
+    Virtual_Disk::writeCluster(vector<char>(Mini_FAT::getClusterSize(), 0), newCluster);
     Directory_Entry newDirEntry(cleanedName, 0x10, newCluster);
-    newDirEntry.subDirectory = newDir; // Associate the entry with the new directory
-
-    // Step 9: Add the new directory entry to the parent directory
-    parentDir->DirOrFiles.push_back(newDirEntry);
 
-    // Step 10: Write changes to the parent directory
-    parentDir->writeDirectory();
+    // Step 8: Add the new directory entry to the parent directory and write the changes
+    if (!parentDir->addEntry(newDirEntry))
+    {
+        Mini_FAT::freeChain(newCluster);
+        cout << "Error: Not enough space to add '" << cleanedName << "' to the directory.\n";
+        return;
+    }
 
     cout << "Directory '" << cleanedName << "' created successfully.\n";
 }
@@ -590,16 +656,21 @@ void CommandHandler::processRd(const vector<string>& directories)
         }
 
         // Step 5: Check if the directory is empty
-        if (!dirEntry.subDirectory->isEmpty())
+        Directory* targetDir = Dentry_Cache::lookup(parentDir, dirName);
+        if (targetDir == nullptr || !targetDir->isEmpty())
         {
             cout << "Error: Directory '" << dirPath << "' is not empty. Please remove its contents first.\n";
             continue;
         }
+        if (targetDir == *currentDirectoryPtr)
+        {
+            cout << "Error: Cannot remove the current directory '" << dirPath << "'.\n";
+            continue;
+        }
 
-        // Step 6: Delete the directory
-        delete dirEntry.subDirectory; // Free memory
-        parentDir->DirOrFiles.erase(parentDir->DirOrFiles.begin() + dirIndex);
-        parentDir->writeDirectory();
+        // Step 6: Delete the directory: its clusters are freed and its entry removed, which also frees its cached
+        // Directory object
+        targetDir->deletDirectory();
 
         cout << "Directory '" << dirPath << "' was successfully deleted.\n";
     }
@@ -634,114 +705,37 @@ void CommandHandler::processCd(const string& path)
         return;
     }
 
-    // Determine if the path is absolute
-    bool isAbsolute = false;
     Directory* traversalDir = *currentDirectoryPtr;
-    string drive = "";
-    size_t startIndex = 0;
+    string_view remaining(path);
 
     // Check if the path starts with a drive letter, e.g., "C:\"
     if (path.length() >= 3 && isalpha(path[0]) && path[1] == ':' && path[2] == '\\')
     {
-        isAbsolute = true;
-        drive = path.substr(0, 2); // e.g., "C:"
-
-        // Convert drive to uppercase for case-insensitive comparison
-        drive = toUpper(drive);
-
         // Traverse up to the root directory
         while (traversalDir->parent != nullptr)
         {
             traversalDir = traversalDir->parent;
         }
 
-        // Debugging Statements
-
         // Verify the drive letter matches (case-insensitive)
-        string traversalDrive = toUpper(traversalDir->name.substr(0, 2));
-        if (traversalDrive != drive)
+        if (toupper(static_cast<unsigned char>(path[0])) != toupper(static_cast<unsigned char>(traversalDir->name[0])))
         {
-            cout << "Error: Drive '" << drive << "' not found.\n";
+            cout << "Error: Drive '" << static_cast<char>(toupper(static_cast<unsigned char>(path[0]))) << ":' not found.\n";
             return;
         }
 
-        // Update the path to remove the drive part
-        // Example: "C:\omar\omar1" becomes "omar\omar1"
-        string updatedPath = path.substr(3); // Skip "C:\"
-        // Split the updated path
-        vector<string> pathComponents;
-        string component;
-        stringstream ss(updatedPath);
-        while (getline(ss, component, '\\'))
-        {
-            if (!component.empty())
-                pathComponents.push_back(component);
-        }
-
-        // Start traversing from the root
-        for (const auto& dirName : pathComponents)
-        {
-            if (dirName == ".")
-            {
-                // Current directory: do nothing
-                continue;
-            }
-            else if (dirName == "..")
-            {
-                if (traversalDir->parent != nullptr)
-                {
-                    traversalDir = traversalDir->parent;
-                }
-                else
-                {
-                    cout << "Error: Already at the root directory.\n";
-                    return;
-                }
-            }
-            else
-            {
-                // Search for the specified subdirectory
-                int dirIndex = traversalDir->searchDirectory(dirName);
-                if (dirIndex == -1)
-                {
-                    cout << "Error: System cannot find the specified folder '" << dirName << "'.\n";
-                    return;
-                }
-
-                // Get the Directory_Entry object
-                Directory_Entry* subDirEntry = &traversalDir->DirOrFiles[dirIndex];
-                if (subDirEntry->dir_attr != 0x10) // 0x10 indicates a directory
-                {
-                    cout << "Error: '" << dirName << "' is not a directory.\n";
-                    return;
-                }
-
-                // Assign traversalDir to the existing subDirectory
-                traversalDir = subDirEntry->subDirectory;
-            }
-        }
-
-        // Update the current directory pointer to traversalDir
-        *currentDirectoryPtr = traversalDir;
-        cout << "Changed directory to: " << (*currentDirectoryPtr)->getFullPath() << "\n";
-        return;
+        // Example: "C:\omar\omar1" is walked from the root as "omar\omar1"
+        remaining.remove_prefix(3);
     }
 
-    // If the path is not absolute, split it normally
-    vector<string> pathComponents;
-    string componentNonAbsolute;
-    stringstream ssNonAbsolute(path);
-    while (getline(ssNonAbsolute, componentNonAbsolute, '\\'))
+    // Walk the components in place; empty ones (doubled or trailing separators) are skipped
+    while (!remaining.empty())
     {
-        if (!componentNonAbsolute.empty())
-            pathComponents.push_back(componentNonAbsolute);
-    }
+        size_t separator = remaining.find('\\');
+        string_view dirName = remaining.substr(0, separator);
+        remaining.remove_prefix(separator == string_view::npos ? remaining.size() : separator + 1);
 
-    // Traverse the path components
-    bool errorOccurred = false;
-    for (const auto& dirName : pathComponents)
-    {
-        if (dirName == ".")
+        if (dirName.empty() || dirName == ".")
         {
             // Current directory: do nothing
             continue;
@@ -756,8 +750,7 @@ void CommandHandler::processCd(const string& path)
             else
             {
                 cout << "Error: Already at the root directory.\n";
-                errorOccurred = true;
-                break;
+                return;
             }
         }
         else
@@ -767,8 +760,7 @@ void CommandHandler::processCd(const string& path)
             if (dirIndex == -1)
             {
                 cout << "Error: System cannot find the specified folder '" << dirName << "'.\n";
-                errorOccurred = true;
-                break;
+                return;
             }
 
             // Get the Directory_Entry object
@@ -776,95 +768,105 @@ void CommandHandler::processCd(const string& path)
             if (subDirEntry->dir_attr != 0x10) // 0x10 indicates a directory
             {
                 cout << "Error: '" << dirName << "' is not a directory.\n";
-                errorOccurred = true;
-                break;
+                return;
             }
 
-            // Assign traversalDir to the existing subDirectory
-            traversalDir = subDirEntry->subDirectory;
+            // Move to the subdirectory through the dentry cache
+            traversalDir = Dentry_Cache::lookup(traversalDir, dirName);
         }
     }
 
-    if (!errorOccurred)
-    {
-        // Update the current directory pointer to traversalDir
-        *currentDirectoryPtr = traversalDir;
-        cout << "Changed directory to: " << (*currentDirectoryPtr)->getFullPath() << "\n";
-    }
-}
-void CommandHandler::processQuit(bool& isRunning)
-{
-    cout << "\n================================================================================================================\n";
-    cout << "                                               Exiting the Shell                                                \n";
-    cout << "================================================================================================================\n";
-    cout << "                                          Thank you for using the Shell.                                                                               \n";
-    cout << "================================================================================================================\n";
-
-    isRunning = false; // Terminate the shell loop
+    // Update the current directory pointer to traversalDir
+    *currentDirectoryPtr = traversalDir;
+    cout << "Changed directory to: " << (*currentDirectoryPtr)->getFullPath() << "\n";
 }
-File_Entry* CommandHandler::navigateToFile(string& path)
+void CommandHandler::processBegin()
 {
-    // Split the given path into directory path and file name
-    size_t lastBackslash = path.find_last_of('\\');
-    if (lastBackslash == string::npos) {
-        cout << "Error: The provided file path is invalid. Please ensure the format is correct.\n";
-        return nullptr;
+    if (userTransaction)
+    {
+        cout << "Error: A transaction is already open. Use 'commit' or 'abort' first.\n";
+        return;
     }
 
-    string dirPath = path.substr(0, lastBackslash);
-    string fileName = path.substr(lastBackslash + 1);
+    // Changes of earlier commands are not part of the transaction
+    Directory::flushAll();
 
-    if (fileName.empty()) {
-        cout << "Error: The file name is missing. Please provide a valid file name.\n";
-        return nullptr;
+    // With a journal, the transaction this command runs in simply stays open
+    if (!Virtual_Disk::isTransactionOpen())
+        Mini_FAT::beginTransaction();
+    userTransaction = true;
+    cout << "Transaction started. Changes are kept in memory until 'commit'.\n";
+}
+void CommandHandler::processCommit()
+{
+    if (!userTransaction)
+    {
+        cout << "Error: No transaction is open.\n";
+        return;
     }
+    Directory::flushAll();
+    Mini_FAT::commitTransaction();
+    userTransaction = false;
+    cout << "Transaction committed.\n";
+}
+void CommandHandler::processAbort()
+{
+    Directory* root = *currentDirectoryPtr;
+    while (root->parent != nullptr)
+        root = root->parent;
+    string currentPath = (*currentDirectoryPtr)->getFullPath();
 
-    // Navigate to the target directory
-    Directory* targetDir = navigateToDir(dirPath);
-    if (targetDir == nullptr) {
-        // The navigateToDir function already prints an appropriate error message
-        return nullptr;
+    if (!userTransaction)
+    {
+        cout << "Error: No transaction is open.\n";
+        return;
     }
+    Mini_FAT::abortTransaction();
+    userTransaction = false;
 
-    // Search for the file in the directory
-    int fileIndex = targetDir->searchDirectory(fileName);
-    if (fileIndex == -1) {
-        cout << "Error: The file '" << fileName << "' could not be found in the directory '"
-            << targetDir->getFullPath() << "'.\n";
-        return nullptr;
-    }
+    // Every loaded directory may hold changes that never reached the disk, so all of them are dropped and re-read
+    Dentry_Cache::clear();
+    root->dir_firstCluster = Mini_FAT::getRootCluster();
+    root->readDirectory();
 
-    Directory_Entry& fileEntry = targetDir->DirOrFiles[fileIndex];
-    if (fileEntry.dir_attr == 0x10) { // 0x10 indicates the entry is a directory
-        cout << "Error: The specified entry '" << fileName << "' is a directory, not a file.\n";
-        return nullptr;
-    }
+    // Go back to the same directory if it still exists, otherwise to the root ("C:\a\b" becomes "a/b")
+    string relativePath = currentPath.substr(min(currentPath.size(), static_cast<size_t>(3)));
+    replace(relativePath.begin(), relativePath.end(), '\\', '/');
+    Directory* dir = root->getDirectoryByPath(relativePath);
+    *currentDirectoryPtr = (dir != nullptr) ? dir : root;
+    cout << "Transaction aborted. All changes since 'begin' were discarded.\n";
+}
+void CommandHandler::processQuit(bool& isRunning)
+{
+    if (userTransaction)
+        cout << "Warning: The open transaction was not committed; its changes are discarded.\n";
 
-    // Create a File_Entry object and read its content
-    File_Entry* file = new File_Entry(fileEntry, targetDir);
-    file->readFileContent();
+    cout << "\n================================================================================================================\n";
+    cout << "                                               Exiting the Shell                                                \n";
+    cout << "================================================================================================================\n";
+    cout << "                                          Thank you for using the Shell.                                                                               \n";
+    cout << "================================================================================================================\n";
 
-    cout << "Success: The file '" << fileName << "' has been located and its content loaded.\n";
-    return file;
+    isRunning = false; // Terminate the shell loop
 }
 Directory* CommandHandler::navigateToDir(const std::string& path) {
-    // Make a local copy of the input path and normalize path separators to '\\'
-    std::string normalizedPath = path;
-    std::replace(normalizedPath.begin(), normalizedPath.end(), '/', '\\');
-
-    // Split the path by '\\'
-    std::vector<std::string> pathComponents;
-    std::stringstream pathStream(normalizedPath);
-    std::string component;
-
-    while (std::getline(pathStream, component, '\\')) {
-        if (!component.empty()) {
-            pathComponents.push_back(component);
-        }
-    }
+    // Split the path on '\\' or '/' while walking it, so no list of components is built
+    std::string_view rest = path;
+    auto nextComponent = [&rest]() {
+        size_t start = rest.find_first_not_of("\\/");
+        if (start == std::string_view::npos) {
+            rest = {};
+            return std::string_view();
+        }
+        rest.remove_prefix(start);
+        std::string_view component = rest.substr(0, rest.find_first_of("\\/"));
+        rest.remove_prefix(component.size());
+        return component;
+    };
+    std::string_view dirName = nextComponent();
 
     // Handle empty path error
-    if (pathComponents.empty()) {
+    if (dirName.empty()) {
         std::cout << "Error: The provided path is empty. Please specify a valid path.\n";
         return nullptr;
     }
@@ -872,17 +874,19 @@ Directory* CommandHandler::navigateToDir(const std::string& path) {
     // Start traversal at the current directory
     Directory* currentDir = *currentDirectoryPtr;
 
-    // Handle root directory navigation (e.g., "C:")
-    std::string rootDrive = toUpper(currentDir->getDrive()) + ":";
-    if (toUpper(pathComponents[0]) == toUpper(rootDrive)) {
+    // Handle root directory navigation (e.g., "C:"); the drive letter matches in either case
+    std::string drive = currentDir->getDrive();
+    auto sameLetter = [](char a, char b) { return std::toupper(static_cast<unsigned char>(a)) == std::toupper(static_cast<unsigned char>(b)); };
+    if (dirName.size() == drive.size() + 1 && dirName.back() == ':'
+        && std::equal(drive.begin(), drive.end(), dirName.begin(), sameLetter)) {
         while (currentDir->parent != nullptr) {
             currentDir = currentDir->parent; // Move to the root directory
         }
-        pathComponents.erase(pathComponents.begin()); // Remove the root drive from path components
+        dirName = nextComponent(); // Skip the root drive
     }
 
     // Traverse the directory path
-    for (const auto& dirName : pathComponents) {
+    for (; !dirName.empty(); dirName = nextComponent()) {
         int dirIndex = currentDir->searchDirectory(dirName);
 
         // Handle directory not found
@@ -900,8 +904,8 @@ Directory* CommandHandler::navigateToDir(const std::string& path) {
             return nullptr;
         }
 
-        // Move to the subdirectory
-        currentDir = entry.subDirectory;
+        // Move to the subdirectory, loaded once and owned by the dentry cache
+        currentDir = Dentry_Cache::lookup(currentDir, dirName);
         if (!currentDir) {
             std::cout << "Error: Unable to access the subdirectory '" << dirName << "'.\n";
             return nullptr;
@@ -942,29 +946,24 @@ void CommandHandler::processDir(const std::string& path) {
     // Display the directory header
     std::cout << "Contents of Directory: " << targetDir->getFullPath() << "\n\n";
 
-    // Separate and classify directory contents
-    std::vector<Directory_Entry> directories, files;
+    // Directories sort before files, each group alphabetically; the entries are ordered through a reused list of
+    // pointers rather than copied
+    static std::vector<const Directory_Entry*> listing;
+    listing.clear();
     int dirCount = 0, fileCount = 0;
     long long totalSize = 0; // Sum of file sizes
 
     for (const auto& entry : targetDir->DirOrFiles) {
-        if (entry.dir_attr == 0x10) { // Directory
-            if (entry.getName() == "." || entry.getName() == "..") {
-                continue; // Skip special directories
-            }
-            directories.push_back(entry);
-        }
-        else { // File
-            files.push_back(entry);
+        if (entry.dir_attr == 0x10 && (entry.getName() == "." || entry.getName() == "..")) {
+            continue; // Skip special directories
         }
+        listing.push_back(&entry);
     }
-
-    // Sort directories and files alphabetically
-    std::sort(directories.begin(), directories.end(), [](const Directory_Entry& a, const Directory_Entry& b) {
-        return a.getName() < b.getName();
-        });
-    std::sort(files.begin(), files.end(), [](const Directory_Entry& a, const Directory_Entry& b) {
-        return a.getName() < b.getName();
+    std::sort(listing.begin(), listing.end(), [](const Directory_Entry* a, const Directory_Entry* b) {
+        bool aIsDir = a->dir_attr == 0x10, bIsDir = b->dir_attr == 0x10;
+        if (aIsDir != bIsDir)
+            return aIsDir;
+        return a->getName() < b->getName();
         });
 
     // Define formatting for display
@@ -977,28 +976,30 @@ void CommandHandler::processDir(const std::string& path) {
     std::cout << std::left << std::setw(nameWidth) << "----"
         << std::right << std::setw(sizeWidth) << "----\n";
 
-    // Display directories
-    for (const auto& d : directories) {
-        std::string name = d.getName();
-        if (name.empty()) {
-            name = "<Unnamed Directory>";
+    for (const Directory_Entry* entry : listing) {
+        std::string name = entry->getName();
+        if (entry->dir_attr == 0x10) {
+            // Display directories; the tag is padded along with the name
+            if (name.empty()) {
+                name = "<Unnamed Directory>";
+            }
+            const std::string_view tag = " <DIR>";
+            int padding = std::max(0, nameWidth - static_cast<int>(name.size() + tag.size()));
+            std::cout << name << tag << std::setw(padding) << ""
+                << std::right << std::setw(sizeWidth) << "-" << "\n";
+            dirCount++;
         }
-        std::cout << std::left << std::setw(nameWidth) << (name + " <DIR>")
-            << std::right << std::setw(sizeWidth) << "-" << "\n";
-        dirCount++;
-    }
-
-    // Display files
-    for (const auto& f : files) {
-        std::string name = f.getName();
-        if (name.empty()) {
-            name = "<Unnamed File>";
+        else {
+            // Display files
+            if (name.empty()) {
+                name = "<Unnamed File>";
+            }
+            int size = entry->getSize();
+            std::cout << std::left << std::setw(nameWidth) << name
+                << std::right << std::setw(sizeWidth) << size << " bytes\n";
+            fileCount++;
+            totalSize += size;
         }
-        int size = f.getSize();
-        std::cout << std::left << std::setw(nameWidth) << name
-            << std::right << std::setw(sizeWidth) << size << " bytes\n";
-        fileCount++;
-        totalSize += size;
     }
 
     // Calculate free space using FAT information
@@ -1061,32 +1062,21 @@ void CommandHandler::processTouch(const std::string& filePath) {
         }
     }
 
-    // Check if a file with the same name already exists (case-insensitive)
-    for (const auto& entry : parentDir->DirOrFiles) {
-        std::string existingName = entry.getName();
-        std::string newName = fileName;
-
-        // Convert both names to lowercase for case-insensitive comparison
-        std::transform(existingName.begin(), existingName.end(), existingName.begin(),
-            [](unsigned char c) { return std::tolower(c); });
-        std::transform(newName.begin(), newName.end(), newName.begin(),
-            [](unsigned char c) { return std::tolower(c); });
-
-        if (existingName == newName) {
-            std::cout << "Error: A file named '" << fileName << "' already exists in this directory.\n";
-            return;
-        }
+    // Check if a file with the same name already exists (the lookup is case-insensitive)
+    if (parentDir->searchDirectory(fileName) != -1) {
+        std::cout << "Error: A file named '" << fileName << "' already exists in this directory.\n";
+        return;
     }
 
     // Create a new file entry with the specified name and mark it as a file
     Directory_Entry newFileEntry(fileName, 0x00, /*firstCluster=*/0);
     newFileEntry.setIsFile(true); // Explicitly mark as a file
 
-    // Add the new file entry to the parent directory
-    parentDir->DirOrFiles.push_back(newFileEntry);
-
-    // Save the updated directory contents to the virtual disk
-    parentDir->writeDirectory();
+    // Add the new file entry to the parent directory and save it to the virtual disk
+    if (!parentDir->addEntry(newFileEntry)) {
+        std::cout << "Error: Not enough space to add '" << fileName << "' to the directory.\n";
+        return;
+    }
 
     // Confirmation message
     std::cout << "File '" << newFileEntry.getName() << "' created successfully in '"
@@ -1132,46 +1122,45 @@ void CommandHandler::processWrite(const string& filePath) {
         return;
     }
 
-    // 4. Search for the file in the parent directory
-    bool fileFound = false;
-    string lowerFileName = toLower(fileName); // Convert file name to lowercase for case-insensitive matching
-
-    for (auto& entry : parentDir->DirOrFiles) { // Iterate through directory entries
-        if (toLower(entry.getName()) == lowerFileName) { // Compare file names in lowercase
-            if (!entry.getIsFile()) {
-                // If the entry is a directory, not a file
-                cout << "Error: '" << fileName << "' is a directory, not a file.\n";
-                return;
-            }
-
-            // 5. Prompt user for input
-            cout << "Enter text to write to '" << fileName << "'. Type 'END' on a new line to finish:\n";
-
-            string line;
-            string newContent;
-            while (true) {
-                getline(cin, line); // Read user input line by line
-                if (line == "END") // Exit loop if user types 'END'
-                    break;
-                newContent += line + "\n"; // Append line to the file content
-            }
+    // 4. Search for the file in the parent directory (the lookup is case-insensitive)
+    int fileIndex = parentDir->searchDirectory(fileName);
+    if (fileIndex == -1) {
+        // If no matching file is found in the parent directory
+        cout << "Error: File '" << fileName << "' does not exist.\n";
+        return;
+    }
 
-            // 6. Update the content
-            entry.setContent(newContent); // Update the content of the file entry
+    Directory_Entry& entry = parentDir->DirOrFiles[fileIndex];
+    if (!entry.getIsFile()) {
+        // If the entry is a directory, not a file
+        cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+        return;
+    }
 
-            // 7. Persist changes to disk
-            parentDir->writeDirectory(); // Write directory changes to the virtual disk
+    // 5. Prompt user for input
+    cout << "Enter text to write to '" << fileName << "'. Type 'END' on a new line to finish:\n";
 
-            cout << "Content successfully written to '" << fileName << "'.\n";
-            fileFound = true; // Mark the file as found and processed
+    // The input is gathered in reused strings, so rewriting a file with text no longer than before does not allocate
+    static string line;
+    static string newContent;
+    newContent.clear();
+    while (true) {
+        // Read user input line by line; exit the loop if the user types 'END' or the input ends
+        if (!getline(cin, line) || line == "END")
             break;
-        }
+        newContent.append(line).push_back('\n'); // Append line to the file content without a temporary
     }
 
-    if (!fileFound) {
-        // If no matching file is found in the parent directory
-        cout << "Error: File '" << fileName << "' does not exist.\n";
+    // 6. Write the content over the file's clusters, reusing its chain, and drop whatever followed it
+    File_Entry file(entry, parentDir);
+    size_t written = file.write(0, span<const char>(newContent.data(), newContent.size()));
+    file.truncate(static_cast<long long>(written));
+    if (written < newContent.size()) {
+        cout << "Error: Not enough space; only " << written << " of " << newContent.size() << " bytes were written to '" << fileName << "'.\n";
+        return;
     }
+
+    cout << "Content successfully written to '" << fileName << "'.\n";
 }
 bool CommandHandler::isValidFileName(const std::string& name) {
     // 1. Validate the length of the name
@@ -1262,31 +1251,27 @@ void CommandHandler::processType(const vector<string>& filePaths) {
             continue; // Proceed to the next file path
         }
 
-        // Step 3: Search for the file in the parent directory
-        bool fileFound = false;
-        string lowerFileName = toLower(fileName); // Convert to lowercase for case-insensitive search
-
-        for (const auto& entry : parentDir->DirOrFiles) {
-            if (toLower(entry.getName()) == lowerFileName) {
-                if (!entry.getIsFile()) {
-                    // If the entry is a directory, not a file
-                    cout << "Error: '" << fileName << "' is a directory, not a file.\n";
-                    fileFound = true; // Mark as found to avoid general error message
-                    break;
-                }
+        // Step 3: Search for the file in the parent directory (the lookup is case-insensitive)
+        int fileIndex = parentDir->searchDirectory(fileName);
 
-                // Step 4: File found, display its content
-                cout << "Content of '" << fileName << "':\n";
-                cout << entry.getContent() << "\n"; // Assuming `getContent()` retrieves file content
-                fileFound = true; // Mark as processed
-                break;
-            }
+        // Step 4: Handle case where the file is not found
+        if (fileIndex == -1) {
+            cout << "Error: File '" << fileName << "' does not exist.\n";
+            continue;
         }
 
-        // Step 5: Handle case where the file is not found
-        if (!fileFound) {
-            cout << "Error: File '" << fileName << "' does not exist.\n";
+        const Directory_Entry& entry = parentDir->DirOrFiles[fileIndex];
+        if (!entry.getIsFile()) {
+            // If the entry is a directory, not a file
+            cout << "Error: '" << fileName << "' is a directory, not a file.\n";
+            continue;
         }
+
+        // Step 5: File found, stream its content a cluster at a time
+        cout << "Content of '" << fileName << "':\n";
+        File_Entry file(entry, parentDir);
+        file.streamTo(cout);
+        cout << "\n";
     }
 }
 void CommandHandler::processDel(const vector<string>& targets) {
@@ -1357,26 +1342,26 @@ void CommandHandler::processDel(const vector<string>& targets) {
                     continue;
                 }
 
-                // Delete all files in the directory
-                for (auto it = targetDir->DirOrFiles.begin(); it != targetDir->DirOrFiles.end();) {
-                    if (it->dir_attr != 0x10) { // Only process files
-                        string fileName = it->getName();
+                // Delete all files in the directory; deleteFile() removes the entry from targetDir, so the
+                // next entry moves into the same position
+                for (size_t i = 0; i < targetDir->DirOrFiles.size();) {
+                    if (targetDir->DirOrFiles[i].dir_attr != 0x10) { // Only process files
+                        string fileName = targetDir->DirOrFiles[i].getName();
                         cout << "Are you sure you want to delete the file '" << fileName << "'? (y/n): ";
                         cin >> confirmation;
                         cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
                         if (tolower(confirmation) == 'y') {
-                            File_Entry file(*it, targetDir);
+                            File_Entry file(targetDir->DirOrFiles[i], targetDir);
                             file.deleteFile();
                             cout << "File '" << fileName << "' deleted successfully.\n";
-                            it = targetDir->DirOrFiles.erase(it); // Remove from directory
                         }
                         else {
-                            ++it;
+                            ++i;
                         }
                     }
                     else {
-                        ++it; // Skip subdirectories
+                        ++i; // Skip subdirectories
                     }
                 }
 
@@ -1396,14 +1381,10 @@ void CommandHandler::processDel(const vector<string>& targets) {
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
             if (tolower(confirmation) == 'y') {
-                // Delete the file
+                // Delete the file; this also removes its entry from the parent and persists the change
                 File_Entry file(*dirEntry, parentDir);
                 file.deleteFile();
                 cout << "File '" << fileName << "' deleted successfully.\n";
-
-                // Remove the file entry and persist changes
-                parentDir->DirOrFiles.erase(parentDir->DirOrFiles.begin() + entryIndex);
-                parentDir->writeDirectory();
             }
             else {
                 cout << "Skipped deletion of '" << fileName << "'.\n";
@@ -1467,15 +1448,13 @@ void CommandHandler::processRename(const vector<string>& args) {
     }
 
     // Step 6: Check for duplicate file names in the directory
-    for (const auto& entry : targetDir->DirOrFiles) {
-        if (entry.getName() == newFileName) {
-            cout << "Error: A file named '" << newFileName << "' already exists in the directory.\n";
-            return;
-        }
+    if (targetDir->searchDirectory(newFileName) != -1) {
+        cout << "Error: A file named '" << newFileName << "' already exists in the directory.\n";
+        return;
     }
 
     // Step 7: Rename the file
-    fileEntry.assignDir_Name(newFileName); // Update the name in the directory entry
+    targetDir->renameEntry(fileIndex, newFileName); // Update the name in the directory entry and the name index
     targetDir->writeDirectory();          // Persist changes to disk
 
     // Step 8: Confirm success
@@ -1533,7 +1512,7 @@ void CommandHandler::processCopy(const vector<string>& args)
     Directory_Entry& sourceEntry = sourceDir->DirOrFiles[sourceIndex];
 
     // **Handle File Copying**
-    if (sourceEntry.dir_attr == 0x00) // 0x00 indicates a file
+    if (sourceEntry.getIsFile())
     {
         // **Determine Destination Directory and File Name**
         Directory* destinationDir = nullptr;
@@ -1616,7 +1595,7 @@ void CommandHandler::processCopy(const vector<string>& args)
             {
                 // **Destination is a Directory**
                 destIsDirectory = true;
-                destinationDir = destinationDir->DirOrFiles[destIndex].subDirectory;
+                destinationDir = Dentry_Cache::lookup(destinationDir, destFileName);
                 destFileName = sourceName; // Copy with Same Name into Destination Directory
             }
         }
@@ -1643,18 +1622,19 @@ void CommandHandler::processCopy(const vector<string>& args)
                 }
 
                 // **Overwrite Existing File**
-                Directory_Entry& existingEntry = destinationDir->DirOrFiles[existingIndex];
-                existingEntry = sourceEntry; // Assuming Shallow Copy is Sufficient
+                if (!copyFileData(sourceEntry, sourceDir, destinationDir, sourceName))
+                {
+                    cout << "Error: Not enough space to copy file '" << sourceName << "'.\n";
+                    cout << "0 file(s) copied.\n";
+                    return;
+                }
                 cout << "File '" << sourceName << "' overwritten successfully in the destination directory.\n";
                 cout << "1 file(s) copied.\n";
                 return;
             }
 
             // **Destination File Does Not Exist - Proceed to Copy**
-            Directory_Entry newFileEntry = sourceEntry;
-            newFileEntry.assignDir_Name(sourceName); // Assign Same Name
-
-            if (!destinationDir->canAddEntry(newFileEntry))
+            if (!copyFileData(sourceEntry, sourceDir, destinationDir, sourceName))
             {
                 // **Case (6): Not Enough Space**
                 cout << "Error: Not enough space to copy file '" << sourceName << "'.\n";
@@ -1662,7 +1642,6 @@ void CommandHandler::processCopy(const vector<string>& args)
                 return;
             }
 
-            destinationDir->addEntry(newFileEntry);
             cout << "File '" << sourceName << "' copied successfully to the destination directory.\n";
             cout << "1 file(s) copied.\n";
             return;
@@ -1697,18 +1676,19 @@ void CommandHandler::processCopy(const vector<string>& args)
                 }
 
                 // **Overwrite Existing File**
-                Directory_Entry& existingEntry = destinationDir->DirOrFiles[destIndex];
-                existingEntry = sourceEntry; // Assuming Shallow Copy is Sufficient
+                if (!copyFileData(sourceEntry, sourceDir, destinationDir, destFileName))
+                {
+                    cout << "Error: Not enough space to copy file '" << sourceName << "'.\n";
+                    cout << "0 file(s) copied.\n";
+                    return;
+                }
                 cout << "File '" << destFileName << "' overwritten successfully.\n";
                 cout << "1 file(s) copied.\n";
                 return;
             }
 
             // **Destination File Does Not Exist - Proceed to Copy**
-            Directory_Entry newFileEntry = sourceEntry;
-            newFileEntry.assignDir_Name(destFileName); // Assign New File Name
-
-            if (!destinationDir->canAddEntry(newFileEntry))
+            if (!copyFileData(sourceEntry, sourceDir, destinationDir, destFileName))
             {
                 // **Case (6): Not Enough Space**
                 cout << "Error: Not enough space to copy file '" << sourceName << "'.\n";
@@ -1716,7 +1696,6 @@ void CommandHandler::processCopy(const vector<string>& args)
                 return;
             }
 
-            destinationDir->addEntry(newFileEntry);
             cout << "File '" << sourceName << "' copied successfully as '" << destFileName << "'.\n";
             cout << "1 file(s) copied.\n";
             return;
@@ -1773,7 +1752,7 @@ void CommandHandler::processCopy(const vector<string>& args)
             {
                 // **Destination is an Existing Directory**
                 destIsDirectory = true;
-                destinationDir = destinationDir->DirOrFiles[destIndex].subDirectory;
+                destinationDir = Dentry_Cache::lookup(destinationDir, destDirName);
             }
             else if (destIndex != -1 && destinationDir->DirOrFiles[destIndex].dir_attr != 0x10)
             {
@@ -1791,9 +1770,16 @@ void CommandHandler::processCopy(const vector<string>& args)
 
         // **Iterate Through Source Directory Entries and Copy Files**
         int filesCopied = 0;
-        for (const auto& entry : sourceEntry.subDirectory->DirOrFiles)
+        Directory* sourceSubDir = Dentry_Cache::lookup(sourceDir, sourceName);
+        if (sourceSubDir == destinationDir)
+        {
+            cout << "The files cannot be copied onto themselves.\n";
+            cout << "0 file(s) copied.\n";
+            return;
+        }
+        for (const auto& entry : sourceSubDir->DirOrFiles)
         {
-            if (entry.dir_attr == 0x00) // Only Copy Files
+            if (entry.getIsFile()) // Only Copy Files
             {
                 string srcFileName = entry.getName();
                 int destIndex = destinationDir->searchDirectory(srcFileName);
@@ -1814,25 +1800,24 @@ void CommandHandler::processCopy(const vector<string>& args)
                     }
 
                     // **Overwrite Existing File**
-                    Directory_Entry& existingEntry = destinationDir->DirOrFiles[destIndex];
-                    existingEntry = entry; // Assuming Shallow Copy is Sufficient
+                    if (!copyFileData(entry, sourceSubDir, destinationDir, srcFileName))
+                    {
+                        cout << "Error: Not enough space to copy file '" << srcFileName << "'.\n";
+                        continue;
+                    }
                     cout << "File '" << srcFileName << "' overwritten successfully in destination directory.\n";
                     filesCopied++;
                     continue;
                 }
 
                 // **Destination File Does Not Exist - Proceed to Copy**
-                Directory_Entry newFileEntry = entry;
-                newFileEntry.assignDir_Name(srcFileName); // Assign Same Name
-
-                if (!destinationDir->canAddEntry(newFileEntry))
+                if (!copyFileData(entry, sourceSubDir, destinationDir, srcFileName))
                 {
                     // **Case (6): Not Enough Space**
                     cout << "Error: Not enough space to copy file '" << srcFileName << "'.\n";
                     continue;
                 }
 
-                destinationDir->addEntry(newFileEntry);
                 cout << "File '" << srcFileName << "' copied successfully to destination directory.\n";
                 filesCopied++;
             }
@@ -1847,6 +1832,28 @@ void CommandHandler::processCopy(const vector<string>& args)
     // **Unsupported Entry Type**
     cout << "Error: Unsupported entry type for '" << sourceName << "'.\n";
 }
+bool CommandHandler::copyFileData(Directory_Entry source, Directory* sourceDir, Directory* destinationDir, const string& destName)
+{
+    // The data is copied a cluster at a time, so a large file is never held in memory; an existing destination
+    // keeps its clusters and only grows or trims its chain
+    int destIndex = destinationDir->searchDirectory(destName);
+    long long reusable = destIndex != -1 ? File_Entry::clustersOnDisk(destinationDir->DirOrFiles[destIndex].dir_fileSize) : 0;
+    if (File_Entry::clustersOnDisk(source.dir_fileSize) - reusable > Mini_FAT::getFreeClusters())
+        return false;
+
+    if (destIndex == -1)
+    {
+        Directory_Entry newFileEntry(destName, 0x00, /*firstCluster=*/0);
+        newFileEntry.setIsFile(true);
+        if (!destinationDir->canAddEntry(newFileEntry) || !destinationDir->addEntry(newFileEntry))
+            return false;
+        destIndex = destinationDir->searchDirectory(destName);
+    }
+
+    File_Entry from(source, sourceDir);
+    File_Entry to(destinationDir->DirOrFiles[destIndex], destinationDir);
+    return to.copyFrom(from) == source.dir_fileSize;
+}
 void CommandHandler::processImport(const std::vector<std::string>& args) {
     // Check for correct number of arguments
     if (args.empty() || args.size() > 2) {
@@ -1946,12 +1953,10 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                     // Check if directory with the same name already exists in parent
                     bool dirExists = false;
                     Directory* existingDir = nullptr;
-                    for (const auto& entry : parentDir->DirOrFiles) {
-                        if (!entry.getIsFile() && toLower(entry.getName()) == toLower(dirName)) {
-                            dirExists = true;
-                            existingDir = entry.subDirectory;
-                            break;
-                        }
+                    int existingIndex = parentDir->searchDirectory(dirName);
+                    if (existingIndex != -1 && !parentDir->DirOrFiles[existingIndex].getIsFile()) {
+                        dirExists = true;
+                        existingDir = Dentry_Cache::lookup(parentDir, dirName);
                     }
 
                     if (dirExists && existingDir != nullptr) {
@@ -1962,18 +1967,20 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                         // Create the directory
                         char dir_attr = 0x10;               // Directory attribute
                         int dir_firstCluster = 0;           // First cluster (use 0 if not applicable)
-                        Directory* newDir = new Directory(dirName, dir_attr, dir_firstCluster, parentDir);
 
                         // Create a new Directory_Entry for the new directory
-                        Directory_Entry newDirEntry(dirName, 0x10, 0);
+                        Directory_Entry newDirEntry(dirName, dir_attr, dir_firstCluster);
                         newDirEntry.setIsFile(false);          // Mark as directory
-                        newDirEntry.subDirectory = newDir;     // Link the Directory object
 
                         // Add the new directory entry to the parent directory
-                        parentDir->addEntry(newDirEntry);
+                        if (!parentDir->addEntry(newDirEntry)) {
+                            std::cout << "Error: Not enough space to create directory '" << destination << "'.\n";
+                            return;
+                        }
                         parentDir->writeDirectory();           // Persist changes
 
-                        targetDir = newDir;                    // Set the target directory to the newly created directory
+                        // Set the target directory to the newly created directory, loaded by the dentry cache
+                        targetDir = Dentry_Cache::lookup(parentDir, newDirEntry.getName());
                         std::cout << "Directory '" << destination << "' created successfully.\n";
                     }
                 }
@@ -1989,12 +1996,10 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                 // Check if the directory already exists in the current directory
                 bool dirExists = false;
                 Directory* existingDir = nullptr;
-                for (const auto& entry : targetDir->DirOrFiles) {
-                    if (!entry.getIsFile() && toLower(entry.getName()) == toLower(dirName)) {
-                        dirExists = true;
-                        existingDir = entry.subDirectory;
-                        break;
-                    }
+                int existingIndex = targetDir->searchDirectory(dirName);
+                if (existingIndex != -1 && !targetDir->DirOrFiles[existingIndex].getIsFile()) {
+                    dirExists = true;
+                    existingDir = Dentry_Cache::lookup(targetDir, dirName);
                 }
 
                 if (dirExists && existingDir != nullptr) {
@@ -2005,18 +2010,20 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                     // Create the directory
                     char dir_attr = 0x10;               // Directory attribute
                     int dir_firstCluster = 0;           // First cluster (use 0 if not applicable)
-                    Directory* newDir = new Directory(dirName, dir_attr, dir_firstCluster, targetDir);
 
                     // Create a new Directory_Entry for the new directory
-                    Directory_Entry newDirEntry(dirName, 0x10, 0);
+                    Directory_Entry newDirEntry(dirName, dir_attr, dir_firstCluster);
                     newDirEntry.setIsFile(false);          // Mark as directory
-                    newDirEntry.subDirectory = newDir;     // Link the Directory object
 
                     // Add the new directory entry to the target directory
-                    targetDir->addEntry(newDirEntry);
+                    if (!targetDir->addEntry(newDirEntry)) {
+                        std::cout << "Error: Not enough space to create directory '" << destination << "'.\n";
+                        return;
+                    }
                     targetDir->writeDirectory();           // Persist changes
 
-                    targetDir = newDir;                    // Set the target directory to the newly created directory
+                    // Set the target directory to the newly created directory, loaded by the dentry cache
+                    targetDir = Dentry_Cache::lookup(targetDir, newDirEntry.getName());
                     std::cout << "Directory '" << destination << "' created successfully.\n";
                 }
             }
@@ -2048,17 +2055,13 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                 }
 
                 // Check if the file already exists in the target directory
-                bool fileExists = false;
-                int existingFileIndex = -1;
-                for (size_t i = 0; i < targetDir->DirOrFiles.size(); ++i) {
-                    // Case-insensitive comparison
-                    if (toLower(targetDir->DirOrFiles[i].getName()) == toLower(fileName)) {
-                        fileExists = true;
-                        existingFileIndex = static_cast<int>(i);
-                        break;
-                    }
-                }
+                int existingFileIndex = targetDir->searchDirectory(fileName); // Case-insensitive lookup
+                bool fileExists = (existingFileIndex != -1);
 
+                if (fileExists && !targetDir->DirOrFiles[existingFileIndex].getIsFile()) {
+                    std::cout << "Error: '" << fileName << "' is a directory in the destination. Skipping import.\n";
+                    continue;
+                }
                 if (fileExists) {
                     // Prompt to overwrite
                     std::cout << "File '" << fileName << "' already exists. Do you want to overwrite it? (yes/no): ";
@@ -2071,34 +2074,42 @@ void CommandHandler::processImport(const std::vector<std::string>& args) {
                     }
                 }
 
-                // Read the content of the source file
+                // Open the source file; its content is streamed in a cluster at a time rather than read whole
                 std::ifstream inputFile(entry.path(), std::ios::binary);
                 if (!inputFile.is_open()) {
                     std::cout << "Error: Unable to open source file '" << entry.path().string() << "'. Skipping import.\n";
                     continue;
                 }
-                std::string fileContent((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
-                inputFile.close();
+                long long sourceSize = static_cast<long long>(fs::file_size(entry.path()));
 
-                // Debug Statement
+                if (!fileExists) {
+                    // Create a new, empty file entry
+                    Directory_Entry newFile(fileName, 0x00, /*firstCluster=*/0); // attr=0x00 for file
+                    newFile.setIsFile(true);                      // Mark as file
+                    if (!targetDir->canAddEntry(newFile)) {
+                        std::cout << "Error: Not enough space to import '" << fileName << "'.\n";
+                        continue;
+                    }
+                    if (!targetDir->addEntry(newFile)) {          // Add to directory
+                        std::cout << "Error: Not enough space to import '" << fileName << "'.\n";
+                        continue;
+                    }
+                    existingFileIndex = targetDir->searchDirectory(fileName);
+                }
 
-                if (fileExists && existingFileIndex != -1) {
-                    // Overwrite the existing file's content
-                    Directory_Entry& existingEntry = targetDir->DirOrFiles[existingFileIndex];
-                    existingEntry.setContent(fileContent);
-                    existingEntry.setIsFile(true);      // Ensure it's marked as a file
-                    existingEntry.dir_attr = 0x00;      // Ensure dir_attr is set correctly
-                    targetDir->writeDirectory();
+                // Write the content over the file's clusters, keeping its chain and only growing or trimming the tail
+                File_Entry file(targetDir->DirOrFiles[existingFileIndex], targetDir);
+                long long stored = file.streamFrom(inputFile);
+                inputFile.close();
+                if (stored < sourceSize) {
+                    std::cout << "Error: Not enough space; only " << stored << " of " << sourceSize << " bytes of '" << fileName << "' were imported.\n";
+                    continue;
+                }
+
+                if (fileExists) {
                     std::cout << "File '" << fileName << "' overwritten and imported successfully.\n";
                 }
                 else {
-                    // Create a new file entry
-                    Directory_Entry newFile(fileName, 0x00, static_cast<int>(fileContent.size())); // attr=0x00 for file
-                    newFile.setIsFile(true);                      // Mark as file
-                    newFile.dir_attr = 0x00;                      // Ensure dir_attr is set correctly
-                    newFile.setContent(fileContent);              // Set file content and update size
-                    targetDir->addEntry(newFile);                 // Add to directory
-                    targetDir->writeDirectory();                   // Write changes
                     std::cout << "File '" << fileName << "' imported successfully.\n";
                     importedFileCount++;
                 }
@@ -2121,6 +2132,7 @@ void CommandHandler::processExport(const std::vector<std::string>& args) {
 
     Directory* currentDir = *currentDirectoryPtr;
     Directory_Entry* sourceEntry = nullptr;
+    Directory* sourceParent = currentDir;
 
     bool isSourceAbsolutePath = (sourcePath.length() >= 3 && isalpha(sourcePath[0]) && sourcePath[1] == ':' && (sourcePath[2] == '\\' || sourcePath[2] == '/'));
 
@@ -2142,6 +2154,7 @@ void CommandHandler::processExport(const std::vector<std::string>& args) {
         }
 
         sourceEntry = &resolvedDir->DirOrFiles[entryIndex];
+        sourceParent = resolvedDir;
     }
     else {
         int entryIndex = currentDir->searchDirectory(sourcePath);
@@ -2157,49 +2170,50 @@ void CommandHandler::processExport(const std::vector<std::string>& args) {
 
     // Check if source is a directory
     if (sourceEntry->dir_attr == 0x10) { // Directory
-        Directory sourceDir(sourceEntry->getName(), sourceEntry->dir_attr, sourceEntry->dir_firstCluster, currentDir);
-        sourceDir.readDirectory();
+        Directory* sourceDir = Dentry_Cache::lookup(sourceParent, sourceEntry->getName());
 
-        for (const auto& entry : sourceDir.DirOrFiles) {
+        // Each file is streamed out a cluster at a time, so no file is ever held in memory whole
+        std::vector<File_Entry> files;
+        for (const auto& entry : sourceDir->DirOrFiles) {
             if (entry.dir_attr != 0x10) { // Export files only
-                File_Entry file(entry, &sourceDir);
-                file.readFileContent();
-
-                std::string destinationFilePath = (fs::path(destinationPath) / entry.getName()).string();
-
-                // Check for overwrite
-                if (fs::exists(destinationFilePath)) {
-                    std::cout << "File '" << destinationFilePath << "' already exists. Overwrite? (yes/no): ";
-                    std::string choice;
-                    std::getline(std::cin, choice);
-                    std::transform(choice.begin(), choice.end(), choice.begin(), ::tolower);
-                    if (choice != "yes") {
-                        std::cout << "Skipping '" << entry.getName() << "'.\n";
-                        continue;
-                    }
-                }
+                files.emplace_back(entry, sourceDir);
+            }
+        }
+
+        for (auto& file : files) {
+            std::string destinationFilePath = (fs::path(destinationPath) / file.getName()).string();
 
-                std::ofstream outFile(destinationFilePath, std::ios::binary);
-                if (!outFile.is_open()) {
-                    std::cout << "Error: Unable to open destination file '" << destinationFilePath << "'.\n";
+            // Check for overwrite
+            if (fs::exists(destinationFilePath)) {
+                std::cout << "File '" << destinationFilePath << "' already exists. Overwrite? (yes/no): ";
+                std::string choice;
+                std::getline(std::cin, choice);
+                std::transform(choice.begin(), choice.end(), choice.begin(), ::tolower);
+                if (choice != "yes") {
+                    std::cout << "Skipping '" << file.getName() << "'.\n";
                     continue;
                 }
+            }
 
-                outFile.write(file.content.c_str(), file.content.size());
-                outFile.close();
-
-                exportedFiles++;
+            std::ofstream outFile(destinationFilePath, std::ios::binary);
+            if (!outFile.is_open()) {
+                std::cout << "Error: Unable to open destination file '" << destinationFilePath << "'.\n";
+                continue;
             }
+
+            file.streamTo(outFile);
+            outFile.close();
+
+            exportedFiles++;
         }
 
-        std::cout << "Total files exported from '" << sourceDir.getFullPath() << "': " << exportedFiles << "\n";
+        std::cout << "Total files exported from '" << sourceDir->getFullPath() << "': " << exportedFiles << "\n";
         return;
     }
 
     // If source is a single file
     if (sourceEntry->dir_attr != 0x10) {
-        File_Entry file(*sourceEntry, currentDir);
-        file.readFileContent();
+        File_Entry file(*sourceEntry, sourceParent);
 
         std::string destinationFilePath = destinationPath;
         if (fs::is_directory(destinationPath)) {
@@ -2224,7 +2238,7 @@ void CommandHandler::processExport(const std::vector<std::string>& args) {
             return;
         }
 
-        outFile.write(file.content.c_str(), file.content.size());
+        file.streamTo(outFile);
         outFile.close();
 
         exportedFiles++;
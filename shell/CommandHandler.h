@@ -18,6 +18,8 @@ public:
 
     // Execute the input command
     void executeCommand(const std::string& input, bool& isRunning);
+    // Allocations made by the last command itself, in a build with SHELL_COUNT_ALLOCATIONS; always 0 otherwise
+    long long getLastAllocations() const;
     std::string toLower(const std::string& s);
     std::string toUpper(const std::string& s);
 
@@ -31,6 +33,11 @@ private:
     void processCd(const std::string& dirname);
     
     void processQuit(bool& isRunning);
+
+    // Transaction handlers
+    void processBegin();
+    void processCommit();
+    void processAbort();
     
     void processDir(const std::string& path);
     void processTouch(const std::string& filePath);
@@ -44,12 +51,17 @@ private:
 
     // Helper methods
     Directory* navigateToDir(const std::string& path);
-    File_Entry* navigateToFile(std::string& path);
     bool isValidFileName(const std::string& name);
+    // Copies the data of source, a file of sourceDir, into the file destName of destinationDir (created if missing);
+    // returns false when there is no room for the entry or the data. source is a copy on purpose: it usually comes from
+    // sourceDir's entries, which move when destinationDir is the same directory and gains the new entry
+    bool copyFileData(Directory_Entry source, Directory* sourceDir, Directory* destinationDir, const std::string& destName);
 
     // Member variables
     std::unordered_map<std::string, std::pair<std::string, std::string>> commandHelp; // Updated name
     Directory** currentDirectoryPtr;
+    bool userTransaction = false; // Whether 'begin' opened a transaction that 'commit' or 'abort' has not closed yet
+    long long lastAllocations = 0; // Allocations counted for the last command
 };
 
 #endif // COMMANDHANDLER_H
@@ -1,204 +1,93 @@
 #include "Converter.h"
+#include <bit>
+#include <cstring>
 using namespace std;
 
-// Convert an integer to a 4-byte vector in little-endian format
-vector<char> Converter::intToByte(int n)
+void Converter::encodeInt32LE(span<const int> ints, span<char> out)
 {
-    vector<char> bytes(4);
-    for (int i = 0; i < 4; i++)
+    if constexpr (endian::native == endian::little)
     {
-        bytes[i] = (n >> (i * 8)) & 0xFF;  // Extract each byte
+        if (!ints.empty())
+            memcpy(out.data(), ints.data(), ints.size() * sizeof(int));
     }
-    return bytes;
-}
-
-// Convert a 4-byte vector to an integer (little-endian format)
-int Converter::byteToInt(vector<char> bytes)
-{
-    int n = 0;
-    for (int i = 0; i < bytes.size(); ++i)
-    {
-        n = (n << 8) | (bytes[i] & 0xFF);
-    }
-    return n;
-}
-
-// Convert an array of integers to a continuous byte array
-vector<char> Converter::intArrayToByteArray(int* ints, int size)
-{
-    vector<char> bytes;
-    for (int i = 0; i < size; i++)
-    {
-        vector<char> b = Converter::intToByte(ints[i]);
-        bytes.insert(bytes.end(), b.begin(), b.end());
-    }
-    return bytes;
-}
-
-// Convert a byte array back into an array of integers
-void Converter::byteArrayToIntArray(int* ints, vector<char> bytes)
-{
-    for (int i = 0, j = 0; i < bytes.size() && j < bytes.size() /
-        sizeof(int); j++, i += 4)
+    else
     {
-        vector<char> b;
-        for (int k = i; k < (i + 4); k++)
+        for (size_t i = 0; i < ints.size(); i++)
         {
-            b.push_back(bytes[k]);
+            uint32_t v = static_cast<uint32_t>(ints[i]);
+            for (int b = 0; b < 4; b++)
+                out[i * 4 + b] = static_cast<char>(v >> (8 * b));
         }
-        ints[j] = Converter::byteToInt(b);
     }
 }
 
-// Split a byte vector into 1024-byte chunks, padding the last chunk if necessary
-vector<vector<char>> Converter::splitBytes(vector<char> bytes)
+void Converter::decodeInt32LE(span<const char> bytes, span<int> out)
 {
-    vector<vector<char>> ls;
-    if (bytes.size() > 0)
+    if constexpr (endian::native == endian::little)
     {
-        int number_of_arrays = bytes.size() / 1024;
-        int rem = bytes.size() % 1024;
-        for (int i = 0; i < number_of_arrays; i++)
-        {
-            vector<char> b;
-            for (int j = i * 1024, k = 0; k < 1024; j++, k++)
-            {
-                b.push_back(bytes[j]);
-            }
-            ls.push_back(b);
-        }
-        if (rem > 0)
-        {
-            vector<char> b1(1024);
-            for (int i = number_of_arrays * 1024, k = 0; k < rem;
-                i++, k++)
-            {
-                b1.push_back(bytes[i]);
-            }
-            for (int i = rem; i < 1024; i++)
-            {
-                b1.push_back(0);
-            }
-            ls.push_back(b1);
-        }
+        if (!out.empty())
+            memcpy(out.data(), bytes.data(), out.size() * sizeof(int));
     }
     else
     {
-        vector<char> b1(1024);
-        for (int i = 0; i < 1024; i++)
+        for (size_t i = 0; i < out.size(); i++)
         {
-            b1.push_back(0);
+            uint32_t v = 0;
+            for (int b = 0; b < 4; b++)
+                v |= static_cast<uint32_t>(static_cast<unsigned char>(bytes[i * 4 + b])) << (8 * b);
+            out[i] = static_cast<int>(v);
         }
-        ls.push_back(b1);
     }
-    return ls;
 }
 
-
-Directory_Entry Converter::BytesToDirectory_Entry(vector<char> bytes)
+Directory_Slot Converter::Directory_EntryToSlot(const Directory_Entry& d)
 {
-    string name = "";
-    for (int i = 0; i < 11; i++)
-    {
-        name += bytes[i];
-    }
-    char attr = bytes[11];
-    char empty[12];
-    int j = 12;
-    for (int i = 0; i < 12; i++)
-    {
-        empty[i] = bytes[j];
-        j++;
-    }
-    vector<char> fc(4);
-    for (int i = 0; i < fc.size(); i++)
-    {
-        fc.push_back(bytes[j]);
-        j++;
-    }
-    int firstcluster = Converter::byteToInt(fc);
-    vector<char> sz(4);
-    for (int i = 0; i < sz.size(); i++)
-    {
-        sz.push_back(bytes[j]);
-        j++;
-    }
-    int filesize = Converter::byteToInt(sz);
-    Directory_Entry d(name, attr, firstcluster);
-    for (int i = 0; i < 12; i++)
-    {
-        d.dir_empty[i] = empty[i];
-    }
-    d.dir_fileSize = filesize;
-    return d;
+    Directory_Slot slot;
+    memcpy(slot.name, d.dir_name, sizeof(slot.name));
+    slot.attr = d.dir_attr;
+    memcpy(slot.empty, d.dir_empty, sizeof(slot.empty));
+    // The two integers are adjacent in the slot, so they are encoded with one encodeInt32LE
+    int fields[2] = { d.dir_firstCluster, d.dir_fileSize };
+    encodeInt32LE(fields, span<char>(reinterpret_cast<char*>(&slot) + offsetof(Directory_Slot, firstCluster), sizeof(fields)));
+    return slot;
 }
 
-
-
-vector<char> Converter::Directory_EntryToBytes(Directory_Entry d)
+Directory_Entry Converter::BytesToDirectory_Entry(span<const char> bytes)
 {
-    vector<char> bytes(32);
-    for (int j = 0; j < 11; j++)
-    {
-        bytes.push_back(d.dir_name[j]);
-    }
-    bytes.push_back(d.dir_attr);
-    for (int i = 0; i < 12; i++)
-    {
-        bytes.push_back(d.dir_empty[i]);
-    }
-    vector<char> fc = Converter::intToByte(d.dir_firstCluster);
-    for (int i = 0; i < fc.size(); i++)
-    {
-        bytes.push_back(fc[i]);
-    }
-    vector<char> sz = Converter::intToByte(d.dir_fileSize);
-    for (int i = 0; i < sz.size(); i++)
-    {
-        bytes.push_back(sz[i]);
-    }
-    return bytes;
+    // Decoded in place: the name, attribute and reserved bytes are copied out, and the two adjacent integers are read
+    // with one decodeInt32LE
+    Directory_Entry d;
+    memcpy(d.dir_name, bytes.data() + offsetof(Directory_Slot, name), sizeof(d.dir_name));
+    d.dir_attr = bytes[offsetof(Directory_Slot, attr)];
+    memcpy(d.dir_empty, bytes.data() + offsetof(Directory_Slot, empty), sizeof(d.dir_empty));
+    int fields[2];
+    decodeInt32LE(bytes.subspan(offsetof(Directory_Slot, firstCluster), sizeof(fields)), fields);
+    d.dir_firstCluster = fields[0];
+    d.dir_fileSize = fields[1];
+    return d;
 }
 
-
-vector<char> Converter::Directory_EntriesToBytes(vector<Directory_Entry>d)
+vector<char> Converter::Directory_EntriesToBytes(span<const Directory_Entry> d)
 {
-    vector<char> bytes(d.size() * 32);
-    for (int i = 0; i < d.size(); i++)
+    // Each slot is built and copied straight into its place in the one byte array
+    vector<char> bytes(d.size() * sizeof(Directory_Slot));
+    for (size_t i = 0; i < d.size(); i++)
     {
-        vector<char> b = Converter::Directory_EntryToBytes(d[i]);
-        bytes.insert(bytes.end(), b.begin(), b.end());
+        Directory_Slot slot = Directory_EntryToSlot(d[i]);
+        memcpy(bytes.data() + i * sizeof(Directory_Slot), &slot, sizeof(slot));
     }
     return bytes;
 }
 
-vector<Directory_Entry> Converter::BytesToDirectory_Entries(vector<char>
-    bytes)
+vector<Directory_Entry> Converter::BytesToDirectory_Entries(span<const char> bytes)
 {
-    vector<Directory_Entry> DirsFiles(bytes.size() / 32);
-    for (int i = 0; i < bytes.size(); i += 32)
+    // A zero first byte ends the directory; a tombstone marks a slot freed by removeEntry
+    vector<Directory_Entry> DirsFiles;
+    DirsFiles.reserve(bytes.size() / sizeof(Directory_Slot));
+    for (size_t offset = 0; offset + sizeof(Directory_Slot) <= bytes.size() && bytes[offset] != 0; offset += sizeof(Directory_Slot))
     {
-        vector<char> b;
-        for (int j = i; j < (i + 32); j++)
-        {
-            b.push_back(bytes[j]);
-        }
-        if (b[0] == 0)
-            break;
-        DirsFiles.push_back(Converter::BytesToDirectory_Entry(b));
+        if (bytes[offset] != TOMBSTONE)
+            DirsFiles.push_back(BytesToDirectory_Entry(bytes.subspan(offset, sizeof(Directory_Slot))));
     }
     return DirsFiles;
 }
-
-vector<char> Converter::StringToBytes(string s)
-{
-    vector<char> bytes(s.begin(), s.end());
-    bytes.push_back('\0');
-    return bytes;
-}
-
-string Converter::BytesToString(vector<char> b)
-{
-    string s = string(b.begin(), b.end());
-    return s;
-}
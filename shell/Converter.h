@@ -2,39 +2,53 @@
 #include "Directory_Entry.h"
 #include "Virtual_Disk.h"
 #include "Mini_FAT.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
 #include <vector>
 #include <string>
+#include <string_view>
 using namespace std;
 
+// On-disk layout of one 32-byte directory slot. The integers are kept as little-endian byte arrays, so the struct has
+// no padding and the same bytes on every host; its offsets also locate the fields when a slot is decoded in place
+struct Directory_Slot
+{
+    char name[11];
+    char attr;
+    char empty[12];
+    uint8_t firstCluster[4];
+    uint8_t fileSize[4];
+};
+static_assert(sizeof(Directory_Slot) == 32, "a directory slot is 32 bytes");
+static_assert(is_trivially_copyable_v<Directory_Slot> && is_standard_layout_v<Directory_Slot>, "slots are copied as raw bytes");
+static_assert(offsetof(Directory_Slot, attr) == 11 && offsetof(Directory_Slot, empty) == 12
+    && offsetof(Directory_Slot, firstCluster) == 24 && offsetof(Directory_Slot, fileSize) == 28, "slot fields are at their on-disk offsets");
+
 class Converter
 {
 public:
-    // Converts an integer to a 4-byte vector (little-endian format)
-    static vector<char> intToByte(int n);
+    // First name byte of a directory slot whose entry was removed; the slot is skipped and can be reused
+    static const char TOMBSTONE = static_cast<char>(0xE5);
 
-    // Converts a 4-byte vector to an integer (little-endian format)
-    static int byteToInt( vector<char> bytes);
+    // Integers on disk (FAT entries, superblock and journal fields, slot fields) are 32-bit two's complement,
+    // little-endian. On a little-endian host the bulk codec is a plain memcpy; elsewhere each value is byte-swapped
 
-    // Converts an array of integers to a byte array
-    static vector<char> intArrayToByteArray( int* ints, int size);
+    // Writes ints as 4 little-endian bytes each to the start of out, which must hold ints.size() * 4 bytes
+    static void encodeInt32LE(span<const int> ints, span<char> out);
 
-    // Converts a byte array back to an array of integers
-    static void byteArrayToIntArray(int* ints,  vector<char> bytes);
-
-    // Splits a byte vector into chunks of 1024 bytes (pads if necessary)
-    static vector<vector<char>> splitBytes( vector<char> bytes);
+    // Reads out.size() little-endian integers from the start of bytes, which must hold out.size() * 4 bytes
+    static void decodeInt32LE(span<const char> bytes, span<int> out);
 
     // Converts a byte vector to a Directory_Entry object
-    static Directory_Entry BytesToDirectory_Entry( vector<char> bytes);
-
-    // Converts a Directory_Entry object to a byte vector
-    static vector<char> Directory_EntryToBytes( Directory_Entry d);
+    static Directory_Entry BytesToDirectory_Entry(span<const char> bytes);
 
-    static vector<char> Directory_EntriesToBytes(vector<Directory_Entry> d);
+    // Converts a Directory_Entry to its on-disk slot
+    static Directory_Slot Directory_EntryToSlot(const Directory_Entry& d);
 
-    static vector<Directory_Entry> BytesToDirectory_Entries(vector<char> bytes);
+    static vector<char> Directory_EntriesToBytes(span<const Directory_Entry> d);
 
-    static vector<char> StringToBytes(string s);
-    
-    static string BytesToString(vector<char> b);
+    // Converts consecutive 32-byte slots to entries, skipping tombstones and stopping at a slot starting with a zero byte
+    static vector<Directory_Entry> BytesToDirectory_Entries(span<const char> bytes);
 };
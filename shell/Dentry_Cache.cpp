@@ -0,0 +1,202 @@
+#include "Dentry_Cache.h"
+#include "Directory.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+using namespace std;
+
+list<Dentry_Cache::Node> Dentry_Cache::lru;
+unordered_map<Dentry_Cache::Key, list<Dentry_Cache::Node>::iterator, Dentry_Cache::KeyHash> Dentry_Cache::entries;
+unordered_map<const Directory*, list<Dentry_Cache::Node>::iterator> Dentry_Cache::directoryNodes;
+size_t Dentry_Cache::memoryUsage = 0;
+long long Dentry_Cache::hits = 0;
+long long Dentry_Cache::misses = 0;
+
+bool Dentry_Cache::Key::operator==(const Key& other) const
+{
+    return parent == other.parent && name == other.name;
+}
+
+size_t Dentry_Cache::KeyHash::operator()(const Key& key) const
+{
+    return hash<const Directory*>()(key.parent) ^ (hash<string>()(key.name) * 31);
+}
+
+string Dentry_Cache::fold(string_view name)
+{
+    string folded(name);
+    transform(folded.begin(), folded.end(), folded.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return folded;
+}
+
+Directory* Dentry_Cache::lookup(Directory* parent, string_view name)
+{
+    Key key{ parent, fold(name) };
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        hits++;
+        lru.splice(lru.begin(), lru, it->second);
+        recharge(it->second);
+        return it->second->dir.get();
+    }
+    misses++;
+
+    int index = parent->searchDirectory(name);
+    if (index != -1 && parent->DirOrFiles[index].dir_attr != 0x10)
+    {
+        // Files are not cached; the name index already answers for them
+        return nullptr;
+    }
+
+    // A missing name is remembered as a negative entry; a directory is loaded once and kept
+    unique_ptr<Directory> dir;
+    if (index != -1)
+    {
+        const Directory_Entry& entry = parent->DirOrFiles[index];
+        dir = make_unique<Directory>(entry.getName(), entry.dir_attr, entry.dir_firstCluster, parent);
+        dir->readDirectory();
+    }
+    lru.push_front(Node{ key, std::move(dir) });
+    auto node = lru.begin();
+    entries.emplace(std::move(key), node);
+
+    // The node is linked under the node caching parent, so dropping that directory finds it directly
+    auto owner = directoryNodes.find(parent);
+    node->parentNode = owner != directoryNodes.end() ? owner->second : lru.end();
+    if (owner != directoryNodes.end())
+        owner->second->children.push_back(node);
+    if (node->dir != nullptr)
+        directoryNodes.emplace(node->dir.get(), node);
+    recharge(node);
+    return node->dir.get();
+}
+
+void Dentry_Cache::invalidate(const Directory* parent, string_view name)
+{
+    auto it = entries.find(Key{ parent, fold(name) });
+    if (it != entries.end())
+        drop(it->second);
+}
+
+void Dentry_Cache::rename(const Directory* parent, string_view oldName, string_view newName)
+{
+    invalidate(parent, newName);
+    auto it = entries.find(Key{ parent, fold(oldName) });
+    if (it == entries.end())
+        return;
+
+    auto node = it->second;
+    if (node->dir == nullptr)
+    {
+        // The old name exists now, so the negative entry is simply stale
+        drop(node);
+        return;
+    }
+    entries.erase(it);
+    node->dir->assignDir_Name(newName);
+    node->key.name = fold(newName);
+    entries.emplace(node->key, node);
+    recharge(node);
+}
+
+void Dentry_Cache::clear()
+{
+    // Children are destroyed before their parents, as drop() would do
+    while (!lru.empty())
+        drop(lru.begin());
+}
+
+void Dentry_Cache::drop(list<Node>::iterator node)
+{
+    // Everything cached below the directory points at it as its parent, so it goes first; the children are detached
+    // so that they do not look for themselves in this node's list
+    for (auto child : node->children)
+    {
+        child->parentNode = lru.end();
+        drop(child);
+    }
+    if (node->parentNode != lru.end())
+    {
+        auto& siblings = node->parentNode->children;
+        siblings.erase(find(siblings.begin(), siblings.end(), node));
+    }
+    if (node->dir != nullptr)
+        directoryNodes.erase(node->dir.get());
+    memoryUsage -= node->size;
+    entries.erase(node->key);
+    lru.erase(node);
+}
+
+size_t Dentry_Cache::nodeSize(const Node& node)
+{
+    size_t size = sizeof(Node) + node.key.name.capacity() + node.children.capacity() * sizeof(list<Node>::iterator);
+    if (node.dir != nullptr)
+        size += node.dir->getMemoryUsage();
+    return size;
+}
+
+void Dentry_Cache::recharge(list<Node>::iterator node)
+{
+    size_t size = nodeSize(*node);
+    memoryUsage = memoryUsage - node->size + size;
+    node->size = size;
+}
+
+void Dentry_Cache::trim(const Directory* current)
+{
+    // Commands change the current directory and its ancestors without looking them up again, so those are re-estimated
+    for (const Directory* dir = current; dir != nullptr; dir = dir->parent)
+    {
+        auto owner = directoryNodes.find(dir);
+        if (owner != directoryNodes.end())
+            recharge(owner->second);
+    }
+
+    auto isPinned = [current](const Directory* dir)
+    {
+        for (const Directory* pinned = current; pinned != nullptr; pinned = pinned->parent)
+        {
+            if (pinned == dir)
+                return true;
+        }
+        return false;
+    };
+
+    // Take the least recently used entry that is not pinned; dropping it may take its cached subdirectories along
+    while (memoryUsage > MEMORY_CAP)
+    {
+        auto victim = lru.end();
+        for (auto it = lru.rbegin(); it != lru.rend(); ++it)
+        {
+            if (it->dir == nullptr || !isPinned(it->dir.get()))
+            {
+                victim = prev(it.base());
+                break;
+            }
+        }
+        if (victim == lru.end())
+            break;
+        drop(victim);
+    }
+}
+
+size_t Dentry_Cache::getEntryCount()
+{
+    return entries.size();
+}
+
+size_t Dentry_Cache::getMemoryUsage()
+{
+    return memoryUsage;
+}
+
+long long Dentry_Cache::getHits()
+{
+    return hits;
+}
+
+long long Dentry_Cache::getMisses()
+{
+    return misses;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class Directory;
+
+/** Owns the Directory objects that path resolution loads, keyed by (parent directory, case-folded name), so every
+    directory below the root is loaded at most once and shared by cd, dir, copy, import and the rest. Names that were
+    looked up and not found are remembered as negative entries. The least recently used entries are evicted once the
+    estimated memory use passes MEMORY_CAP, except the current directory and its ancestors. */
+class Dentry_Cache
+{
+public:
+    /** Estimated bytes of cached directories and negative entries kept before trim() starts evicting. */
+    static const size_t MEMORY_CAP = 256 * 1024;
+
+    /** Returns the subdirectory of parent named name (case-insensitive), loading it on a miss, or nullptr when there is
+        no such entry or it is a file. The returned directory is owned by the cache and stays valid until its entry is
+        invalidated or evicted by trim(). */
+    static Directory* lookup(Directory* parent, string_view name);
+
+    /** Drops what is cached for name under parent; a cached directory is freed together with everything cached below it.
+        Called whenever an entry of parent is added, removed or changed. */
+    static void invalidate(const Directory* parent, string_view name);
+
+    /** Moves a cached directory from oldName to newName under parent, dropping any negative entry for newName. */
+    static void rename(const Directory* parent, string_view oldName, string_view newName);
+
+    /** Frees every cached entry, e.g. after an aborted transaction when no loaded directory matches the disk any more. */
+    static void clear();
+
+    /** Evicts least recently used entries until the estimated memory use is within MEMORY_CAP, never evicting current
+        or its ancestors. Called between commands, when no other directory pointer is held. */
+    static void trim(const Directory* current);
+
+    /** Returns the number of cached entries, negative ones included. */
+    static size_t getEntryCount();
+
+    /** Returns the estimated memory used by the cached entries, as a running total: each entry is charged when it is
+        cached and again when it is looked up, renamed, or (for current and its ancestors) trimmed. */
+    static size_t getMemoryUsage();
+
+    static long long getHits();
+    static long long getMisses();
+
+private:
+    struct Key
+    {
+        const Directory* parent;
+        string name;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    /** A cached lookup result; dir is nullptr for a negative entry. */
+    struct Node
+    {
+        Key key;
+        unique_ptr<Directory> dir;
+        /** Estimated bytes this node adds to memoryUsage. */
+        size_t size = 0;
+        /** The nodes cached below dir, and the node caching key.parent (lru.end() when the parent is not cached, as
+            for the root), so a directory is dropped with its subtree without scanning the cache. */
+        vector<list<Node>::iterator> children;
+        list<Node>::iterator parentNode;
+    };
+
+    /** Entries from most to least recently used, the index into that list, and the node caching each directory. */
+    static list<Node> lru;
+    static unordered_map<Key, list<Node>::iterator, KeyHash> entries;
+    static unordered_map<const Directory*, list<Node>::iterator> directoryNodes;
+
+    /** Sum of the size of every node. */
+    static size_t memoryUsage;
+
+    static long long hits;
+    static long long misses;
+
+    /** Lower-cases a name so lookups match the case-insensitive directory search. */
+    static string fold(string_view name);
+
+    /** Frees a node, first dropping every node cached below its directory. */
+    static void drop(list<Node>::iterator node);
+
+    /** Estimated bytes used by one node. */
+    static size_t nodeSize(const Node& node);
+
+    /** Re-estimates a node whose directory may have changed since it was charged, and updates memoryUsage. */
+    static void recharge(list<Node>::iterator node);
+};
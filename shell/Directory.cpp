@@ -1,56 +1,55 @@
 #include "Directory.h"
+#include "Dentry_Cache.h"
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
 #include <cstring>
 #include <sstream>
 using namespace std;
 
-Directory::Directory(string name, char dir_attr, int dir_firstCluster, Directory* pa)
+vector<Directory*> Directory::dirtyDirectories;
+
+Directory::Directory(string_view name, char dir_attr, int dir_firstCluster, Directory* pa)
     : Directory_Entry(name, dir_attr, dir_firstCluster)  
 {
     this-> parent = pa;
 }
 
+Directory::~Directory()
+{
+    // A directory is only destroyed once its entry is gone, so whatever it still had to write is dropped
+    auto it = find(dirtyDirectories.begin(), dirtyDirectories.end(), this);
+    if (it != dirtyDirectories.end())
+        dirtyDirectories.erase(it);
+}
+
 
 Directory_Entry Directory::GetDirectory_Entry()
 {
-    Directory_Entry M(this->dir_name, this->dir_attr, this->dir_firstCluster);
-    for (int i = 0; i < 12; i++)
-    {
-        M.dir_empty[i] = this->dir_empty[i];
-    }
-    M.dir_fileSize = this->dir_fileSize;
-    return M;
+    // The entry is a plain 32-byte record, so the directory's own copy of it is returned as is
+    return *this;
 }
 
 int Directory::getmySizeOnDisk()
 {
-    int size = 0;
-    if (dir_firstCluster != 0)
-    {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
-        {
-            size++;
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-    }
-    return size;
+    return Mini_FAT::getChainLength(dir_firstCluster);
 }
 
-bool Directory::canAddEntry(Directory_Entry d)
+bool Directory::canAddEntry(const Directory_Entry& d)
 {
     bool can = false;
+    int clusterSize = static_cast<int>(Mini_FAT::getClusterSize());
     int neededSize = (DirOrFiles.size() + 1) * 32;
-    int neededCluster = neededSize / 1024;
-    int rem = neededSize % 1024;
+    int neededCluster = neededSize / clusterSize;
+    int rem = neededSize % clusterSize;
     if (rem > 0) neededCluster++;
-    neededCluster += d.dir_fileSize / 1024;
-    int rem1 = d.dir_fileSize % 1024;
-    if (rem1 > 0) neededCluster++;
+    // A file small enough to live in its entry takes no clusters of its own
+    if (d.dir_fileSize > Directory_Entry::INLINE_CAPACITY)
+    {
+        neededCluster += d.dir_fileSize / clusterSize;
+        int rem1 = d.dir_fileSize % clusterSize;
+        if (rem1 > 0) neededCluster++;
+    }
     if (getmySizeOnDisk() + Mini_FAT::getAvailableClusters() >= neededCluster)
         can = true;
     return can;
@@ -58,49 +57,242 @@ bool Directory::canAddEntry(Directory_Entry d)
 
 void Directory::emptymyClusters()
 {
-    if (this->dir_firstCluster != 0)
+    // freeChain stops at the end of the chain and never touches the superblock; the root is freed like any directory
+    Mini_FAT::freeChain(this->dir_firstCluster);
+}
+
+void Directory::updatecontent(const Directory_Entry& OLD, const Directory_Entry& New)
+{
+    // Both keys are taken first: OLD may be the very entry that is overwritten
+    NameKey oldKey = makeKey(OLD);
+    NameKey newKey = makeKey(New);
+    int index = findKey(oldKey);
+    if (index != -1)
     {
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        if (cluster == 5 && next == 0)
+        bool renamed = !(newKey == oldKey);
+        if (renamed)
+        {
+            Dentry_Cache::invalidate(this, OLD.getName());
+            Dentry_Cache::invalidate(this, New.getName());
+        }
+        DirOrFiles[index] = New;
+        nameKeys[index] = newKey;
+        // A changed name moves the entry to another bucket
+        if (renamed)
+            rebuildNameIndex();
+        if (slotsMatchEntries())
+            writeSlot(entrySlots[index], &DirOrFiles[index]);
+        else
+            writeDirectory();
+    }
+}
+
+void Directory::removeEntry(const Directory_Entry& d)
+{
+    int index = findKey(makeKey(d));
+    if (index != -1) {
+        // A removed directory's cached Directory object is freed along with everything cached below it
+        Dentry_Cache::invalidate(this, d.getName());
+
+        if (!slotsMatchEntries()) {
+            DirOrFiles.erase(DirOrFiles.begin() + index);
+            rebuildNameIndex();
+            writeDirectory();
             return;
-        do
+        }
+
+        // Erasing shifts the positions of every later entry, so the index is rebuilt
+        int slot = entrySlots[index];
+        DirOrFiles.erase(DirOrFiles.begin() + index);
+        entrySlots.erase(entrySlots.begin() + index);
+        rebuildNameIndex();
+
+        if (DirOrFiles.empty())
         {
-            Mini_FAT::setClusterPointer(cluster, 0);
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
+            // The last entry is gone: give the clusters back, as writeDirectory() does
+            writeDirectory();
+        }
+        else if (slot == slotCount - 1)
+        {
+            // The last slot becomes the end of the directory again
+            writeSlot(slot, nullptr);
+            slotCount--;
+        }
+        else
+        {
+            writeSlot(slot, nullptr);
+            freeSlots.push_back(slot);
+        }
     }
+    
 }
 
-void Directory::updatecontent(Directory_Entry OLD, Directory_Entry New)
+bool Directory::addEntry(const Directory_Entry& d)
 {
-    readDirectory();
-    int index = searchDirectory(OLD.dir_name);
-    if (index != -1)
+    // Room for the slot is made before anything changes, so an entry that does not fit leaves the directory as it was.
+    // Reuse a tombstone when there is one, otherwise append a slot, growing the chain when the slot is past its end;
+    // a directory whose slots are unknown is rewritten whole, and needs room for every entry
+    bool rewrite = !slotsMatchEntries();
+    int oldFirstCluster = dir_firstCluster;
+    int slot = -1;
+    if (rewrite)
+    {
+        if (!reserveSlots(static_cast<int>(DirOrFiles.size()) + 1))
+            return false;
+    }
+    else if (!freeSlots.empty())
+    {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        if (!reserveSlots(slotCount + 1))
+            return false;
+        slot = slotCount++;
+    }
+
+    // The name may have been cached as missing
+    Dentry_Cache::invalidate(this, d.getName());
+    DirOrFiles.push_back(d);
+    // d may have been an element of DirOrFiles, which push_back can move
+    nameKeys.push_back(makeKey(DirOrFiles.back()));
+    indexEntry(static_cast<int>(DirOrFiles.size()) - 1);
+    // The superblock records the root's first cluster only while it has entries, so it was not told while the slot
+    // was reserved above
+    if (parent == nullptr)
+        updateParent(oldFirstCluster);
+    if (rewrite)
     {
-        DirOrFiles[index] = New;
         writeDirectory();
+        return true;
     }
+    entrySlots.push_back(slot);
+    writeSlot(slot, &DirOrFiles.back());
+    return true;
 }
 
-void Directory::removeEntry(Directory_Entry d)
+void Directory::renameEntry(int index, string_view newName)
 {
-    auto it = find_if(DirOrFiles.begin(), DirOrFiles.end(), [&](const Directory_Entry& entry) {
-        return entry.getName() == d.getName();
-        });
-    if (it != DirOrFiles.end()) {
-        DirOrFiles.erase(it);
-        writeDirectory();
+    string oldName = DirOrFiles[index].getName();
+    DirOrFiles[index].assignDir_Name(newName);
+    rebuildNameIndex();
+    Dentry_Cache::rename(this, oldName, DirOrFiles[index].getName());
+}
+
+bool Directory::slotsMatchEntries(size_t pending) const
+{
+    return entrySlots.size() + pending == DirOrFiles.size();
+}
+
+bool Directory::reserveSlots(int slots)
+{
+    int clusterSize = static_cast<int>(Mini_FAT::getClusterSize());
+    int neededClusters = (slots * SLOT_SIZE + clusterSize - 1) / clusterSize;
+    int oldFirstCluster = dir_firstCluster;
+    int oldLength = Mini_FAT::getChainLength(dir_firstCluster);
+    if (oldLength >= neededClusters)
+        return true;
+
+    vector<int> clusters = Mini_FAT::resizeChain(dir_firstCluster, neededClusters, parent != nullptr ? parent->dir_firstCluster : -1);
+    if (static_cast<int>(clusters.size()) < neededClusters)
+    {
+        if (!clusters.empty())
+            Mini_FAT::resizeChain(clusters[0], oldLength);
+        return false;
     }
-    
+
+    // Fresh clusters may hold old data; writing them out zeroed keeps the end-of-directory marker after the last slot
+    clusterBuffer.resize(static_cast<size_t>(neededClusters) * clusterSize, 0);
+    for (int i = oldLength; i < neededClusters; i++)
+        markClusterDirty(i);
+
+    dir_firstCluster = clusters[0];
+    updateParent(oldFirstCluster);
+    return true;
 }
 
-void Directory::addEntry(Directory_Entry d)
+void Directory::writeSlot(int slot, const Directory_Entry* entry)
 {
-    DirOrFiles.push_back(d);
-    writeDirectory();
+    size_t offset = static_cast<size_t>(slot) * SLOT_SIZE;
+    if (dir_firstCluster == 0 || offset + SLOT_SIZE > clusterBuffer.size())
+        return;
+
+    // Update the slot in the in-memory copy of the chain; its cluster is written by flushAll().
+    // A removed entry leaves a tombstone, or zeros when it was the last slot
+    char* target = clusterBuffer.data() + offset;
+    if (entry != nullptr)
+    {
+        Directory_Slot bytes = Converter::Directory_EntryToSlot(*entry);
+        memcpy(target, &bytes, SLOT_SIZE);
+    }
+    else
+    {
+        fill(target, target + SLOT_SIZE, 0);
+        if (slot != slotCount - 1)
+            target[0] = Converter::TOMBSTONE;
+    }
+    markClusterDirty(static_cast<int>(offset / Mini_FAT::getClusterSize()));
+}
+
+void Directory::markClusterDirty(int position)
+{
+    if (find(dirtyDirectories.begin(), dirtyDirectories.end(), this) == dirtyDirectories.end())
+        dirtyDirectories.push_back(this);
+    if (find(dirtyClusters.begin(), dirtyClusters.end(), position) == dirtyClusters.end())
+        dirtyClusters.push_back(position);
+}
+
+void Directory::flush()
+{
+    if (dirtyClusters.empty())
+        return;
+
+    // Gather the dirty clusters of the chain and their bytes, in chain order, so consecutive ones go out as one run;
+    // the gathering buffers are kept from one flush to the next
+    size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+    sort(dirtyClusters.begin(), dirtyClusters.end());
+    static vector<int> clusters;
+    static vector<char> bytes;
+    clusters.clear();
+    bytes.clear();
+    clusters.reserve(dirtyClusters.size());
+    bytes.reserve(dirtyClusters.size() * clusterSize);
+    int cluster = dir_firstCluster;
+    int position = 0;
+    for (int dirty : dirtyClusters)
+    {
+        for (; position < dirty && cluster > 0; position++)
+            cluster = Mini_FAT::getClusterPointer(cluster);
+        if (cluster <= 0 || (static_cast<size_t>(dirty) + 1) * clusterSize > clusterBuffer.size())
+            break;
+        clusters.push_back(cluster);
+        bytes.insert(bytes.end(), clusterBuffer.begin() + dirty * clusterSize, clusterBuffer.begin() + (dirty + 1) * clusterSize);
+    }
+    dirtyClusters.clear();
+    Virtual_Disk::writeChangedClusters(clusters, bytes);
+}
+
+void Directory::flushAll()
+{
+    // Every slot a command changed in a directory lands in that directory's copy of its chain, so each dirty cluster
+    // is written once here no matter how many entries in it changed
+    for (Directory* dir : dirtyDirectories)
+        dir->flush();
+    dirtyDirectories.clear();
+}
+
+void Directory::updateParent(int oldFirstCluster)
+{
+    // The parent's entry for this directory only records the first cluster, so nothing else needs it
+    if (parent != nullptr && dir_firstCluster != oldFirstCluster)
+    {
+        Directory_Entry entry = GetDirectory_Entry();
+        parent->updatecontent(entry, entry);
+    }
+    // The root has no parent entry; the superblock records where it starts, and 0 once its clusters are freed
+    else if (parent == nullptr)
+        Mini_FAT::setRootCluster(DirOrFiles.empty() ? 0 : dir_firstCluster);
 }
 
 void Directory::deletDirectory()
@@ -112,89 +304,182 @@ void Directory::deletDirectory()
     }
 }
 
-int Directory::searchDirectory( string name)
+int Directory::searchDirectory(string_view name)
 {
-    for (int i = 0; i < DirOrFiles.size(); i++)
+    NameKey key;
+    if (!makeKey(name, key))
+        return -1;
+    return findKey(key);
+}
+
+bool Directory::NameKey::operator==(const NameKey& other) const
+{
+    return length == other.length && memcmp(text, other.text, length) == 0;
+}
+
+// Same text as getName(): the base name and extension with trailing blanks trimmed, joined by a dot
+Directory::NameKey Directory::makeKey(const Directory_Entry& entry)
+{
+    NameKey key;
+    int baseLength = 8;
+    while (baseLength > 0 && entry.dir_name[baseLength - 1] == ' ')
+        baseLength--;
+    int extensionLength = 3;
+    while (extensionLength > 0 && entry.dir_name[8 + extensionLength - 1] == ' ')
+        extensionLength--;
+
+    key.length = 0;
+    for (int i = 0; i < baseLength; i++)
+        key.text[key.length++] = static_cast<char>(tolower(static_cast<unsigned char>(entry.dir_name[i])));
+    if (extensionLength > 0)
     {
-        string entryName = DirOrFiles[i].getName();
-        if (entryName == name) // Case-sensitive comparison
-            return i;
+        key.text[key.length++] = '.';
+        for (int i = 0; i < extensionLength; i++)
+            key.text[key.length++] = static_cast<char>(tolower(static_cast<unsigned char>(entry.dir_name[8 + i])));
+    }
+    return key;
+}
+
+bool Directory::makeKey(string_view name, NameKey& key)
+{
+    if (name.size() > sizeof(key.text))
+        return false;
+    key.length = static_cast<unsigned char>(name.size());
+    for (size_t i = 0; i < name.size(); i++)
+        key.text[i] = static_cast<char>(tolower(static_cast<unsigned char>(name[i])));
+    return true;
+}
+
+// FNV-1a over the folded text
+size_t Directory::hashKey(const NameKey& key)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < key.length; i++)
+    {
+        hash ^= static_cast<unsigned char>(key.text[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int Directory::findKey(const NameKey& key) const
+{
+    if (nameIndex.empty())
+        return -1;
+    size_t mask = nameIndex.size() - 1;
+    for (size_t slot = hashKey(key) & mask; nameIndex[slot] != -1; slot = (slot + 1) & mask)
+    {
+        if (nameKeys[nameIndex[slot]] == key)
+            return nameIndex[slot];
     }
     return -1;
 }
 
+void Directory::indexEntry(int position)
+{
+    // Keeping the table at most half full keeps probe sequences short
+    if (nameIndex.size() < 2 * DirOrFiles.size())
+    {
+        rebuildNameIndex();
+        return;
+    }
+    size_t mask = nameIndex.size() - 1;
+    size_t slot = hashKey(nameKeys[position]) & mask;
+    while (nameIndex[slot] != -1)
+        slot = (slot + 1) & mask;
+    nameIndex[slot] = position;
+}
+
+void Directory::rebuildNameIndex()
+{
+    nameKeys.resize(DirOrFiles.size());
+    for (size_t i = 0; i < DirOrFiles.size(); i++)
+        nameKeys[i] = makeKey(DirOrFiles[i]);
+
+    size_t capacity = 16;
+    while (capacity < 2 * DirOrFiles.size())
+        capacity *= 2;
+    nameIndex.assign(capacity, -1);
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < DirOrFiles.size(); i++)
+    {
+        size_t slot = hashKey(nameKeys[i]) & mask;
+        while (nameIndex[slot] != -1)
+            slot = (slot + 1) & mask;
+        nameIndex[slot] = static_cast<int>(i);
+    }
+}
+
 
 void Directory::readDirectory() {
+    // A directory without a first cluster is empty
+    DirOrFiles.clear();
+    entrySlots.clear();
+    freeSlots.clear();
+    slotCount = 0;
+    clusterBuffer.clear();
+    dirtyClusters.clear();
     if (this->dir_firstCluster != 0)
     {
-        DirOrFiles.clear();
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        if (cluster == 5 && next == 0)
-            return;
-        vector<char> ls;
-        do
+        clusterBuffer.resize(static_cast<size_t>(Mini_FAT::getChainLength(dir_firstCluster)) * Mini_FAT::getClusterSize());
+        Virtual_Disk::readChain(dir_firstCluster, clusterBuffer);
+
+        DirOrFiles = Converter::BytesToDirectory_Entries(clusterBuffer);
+
+        // Record which slot each entry came from and which slots are tombstones, the same way the entries were decoded
+        for (size_t offset = 0; offset + SLOT_SIZE <= clusterBuffer.size() && clusterBuffer[offset] != 0; offset += SLOT_SIZE)
         {
-            vector<char> clusterData = Virtual_Disk::readCluster(cluster);
-            ls.insert(ls.end(), clusterData.begin(), clusterData.end());
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-
-        DirOrFiles = Converter::BytesToDirectory_Entries(ls);
+            if (clusterBuffer[offset] == Converter::TOMBSTONE)
+                freeSlots.push_back(slotCount);
+            else
+                entrySlots.push_back(slotCount);
+            slotCount++;
+        }
     }
-
+    rebuildNameIndex();
 }
 
 void Directory::writeDirectory()
 {
-    Directory_Entry A = this->GetDirectory_Entry();
+    int oldFirstCluster = this->dir_firstCluster;
+
+    // Every entry goes back to the slot matching its position; tombstones disappear
+    int entryCount = static_cast<int>(this->DirOrFiles.size());
+    entrySlots.resize(entryCount);
+    for (int i = 0; i < entryCount; i++)
+        entrySlots[i] = i;
+    freeSlots.clear();
+    slotCount = entryCount;
+
     if (!this->DirOrFiles.empty())
     {
         vector<char> dirsOrFilesBytes = Converter::Directory_EntriesToBytes(this->DirOrFiles);
-        vector<vector<char>> bytesList = Converter::splitBytes(dirsOrFilesBytes);
-        int clusterFATIndex;
-        if (this->dir_firstCluster != 0)
-        {
-            this->emptymyClusters();
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            this->dir_firstCluster = clusterFATIndex;
-        }
-        else
+        size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+        int neededClusters = max(1, static_cast<int>((dirsOrFilesBytes.size() + clusterSize - 1) / clusterSize));
+
+        // Keep the existing chain and only grow or trim its tail (a new chain goes near the parent directory),
+        // then write just the clusters whose bytes changed
+        vector<int> clusters = Mini_FAT::resizeChain(this->dir_firstCluster, neededClusters, this->parent != nullptr ? this->parent->dir_firstCluster : -1);
+        if (!clusters.empty())
         {
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            if (clusterFATIndex != 0)
-                this->dir_firstCluster = clusterFATIndex;
-        }
-        int lastCluster = -1;
-        for (int i = 0; i < bytesList.size(); i++)
-        {
-            if (clusterFATIndex != -1)
-            {
-                Virtual_Disk::writeCluster(bytesList[i], clusterFATIndex);
-                Mini_FAT::setClusterPointer(clusterFATIndex, -1);
-                if (lastCluster != -1)
-                    Mini_FAT::setClusterPointer(lastCluster, clusterFATIndex);
-                lastCluster = clusterFATIndex;
-                clusterFATIndex = Mini_FAT::getAvailableCluster();
-            }
+            // The new image replaces the in-memory copy; flushAll() writes the clusters whose bytes changed
+            this->dir_firstCluster = clusters[0];
+            dirsOrFilesBytes.resize(clusters.size() * clusterSize, 0);
+            clusterBuffer = std::move(dirsOrFilesBytes);
+            for (int i = 0; i < static_cast<int>(clusters.size()); i++)
+                markClusterDirty(i);
         }
     }
     if (this->DirOrFiles.empty())
     {
+        clusterBuffer.clear();
+        dirtyClusters.clear();
         if (dir_firstCluster != 0)
             this->emptymyClusters();
-        if (parent != nullptr)
-            this->dir_firstCluster = 0;
-    }
-    Directory_Entry B = this->GetDirectory_Entry();
-    if (this->parent != nullptr)
-    {
-        this->parent->updatecontent(A, B);
+        this->dir_firstCluster = 0;
     }
-
-    Mini_FAT::writeFAT();
+    updateParent(oldFirstCluster);
 }
 
 string Directory::getFullPath() const
@@ -231,12 +516,10 @@ string Directory::getFullPath() const
 Directory_Entry Directory::findSubDirectory(const string& dirname)
 {
     // Search for a subdirectory with the given name
-    for (const auto& entry : DirOrFiles)
+    int index = searchDirectory(dirname);
+    if (index != -1 && DirOrFiles[index].dir_attr == 0x10)
     {
-        if (entry.dir_attr == 0x10 && entry.getName() == dirname)
-        {
-            return entry;
-        }
+        return DirOrFiles[index];
     }
     // Return a default entry if not found
     Directory_Entry emptyEntry;
@@ -283,24 +566,10 @@ Directory* Directory::getDirectoryByPath(const string& path)
         }
         else
         {
-            // Subdirectory
-            int dirIndex = traversalDir->searchDirectory(dirName);
-            if (dirIndex == -1)
-            {
-                // Subdirectory not found
+            // Subdirectory, loaded once and owned by the dentry cache; nullptr if it is missing or a file
+            traversalDir = Dentry_Cache::lookup(traversalDir, dirName);
+            if (traversalDir == nullptr)
                 return nullptr;
-            }
-
-            Directory_Entry subDirEntry = traversalDir->DirOrFiles[dirIndex];
-            if (subDirEntry.dir_attr != 0x10)
-            {
-                // Not a directory
-                return nullptr;
-            }
-
-            // Load the subdirectory
-            traversalDir = new Directory(subDirEntry.getName(), subDirEntry.dir_attr, subDirEntry.dir_firstCluster, traversalDir);
-            traversalDir->readDirectory();
         }
     }
 
@@ -329,6 +598,14 @@ string Directory::getDrive() const
 }
 
 
+size_t Directory::getMemoryUsage() const
+{
+    return sizeof(Directory) + name.capacity()
+        + DirOrFiles.capacity() * sizeof(Directory_Entry) + clusterBuffer.capacity()
+        + nameKeys.capacity() * sizeof(NameKey) + nameIndex.capacity() * sizeof(int)
+        + (entrySlots.capacity() + freeSlots.capacity() + dirtyClusters.capacity()) * sizeof(int);
+}
+
 bool Directory::isEmpty() const {
     return DirOrFiles.empty();
 }
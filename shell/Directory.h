@@ -13,31 +13,52 @@ class Directory : public Directory_Entry {
 
 		Directory* parent;
 
+		/** In-memory copy of the directory's chain: read by readDirectory(), changed slot by slot, written by flushAll(). */
+		vector<char> clusterBuffer;
+
         Directory_Entry dir_entry;
 
-        Directory(string name, char dir_attr, int dir_firstCluster, Directory* pa);
+        Directory(string_view name, char dir_attr, int dir_firstCluster, Directory* pa);
+
+		~Directory();
 
 		Directory_Entry GetDirectory_Entry();
 
 		int getmySizeOnDisk();
 
-		bool canAddEntry(Directory_Entry d);
+		bool canAddEntry(const Directory_Entry& d);
 
 		void emptymyClusters();
 
+		/** Rewrites every entry in order, dropping tombstones; use after changing DirOrFiles directly.
+			Like the slot updates below, it allocates or frees clusters at once but only changes the in-memory copy. */
 		void writeDirectory();
 
 		void readDirectory ();
 
-		void addEntry(Directory_Entry d);
+		/** Adds an entry in a free slot (reusing a tombstone when there is one), writing only that slot's cluster. Returns
+			false, adding nothing, when the directory would have to grow and the disk is full. */
+		bool addEntry(const Directory_Entry& d);
 
-		void removeEntry(Directory_Entry d);
+		/** Removes an entry by leaving a tombstone in its slot, writing only that slot's cluster. */
+		void removeEntry(const Directory_Entry& d);
 
 		void deletDirectory();
 
-		void updatecontent(Directory_Entry OLD, Directory_Entry New);
+		/** Replaces the entry named like OLD with New in memory and in its slot; the directory is not re-read. */
+		void updatecontent(const Directory_Entry& OLD, const Directory_Entry& New);
+
+		/** Returns the position of the entry named name (case-insensitive) in DirOrFiles, or -1; O(1) through the name index. */
+		int searchDirectory(string_view name);
 
-		int searchDirectory(string name);
+		/** Renames the entry at position index and updates the name index; the caller persists the change. */
+		void renameEntry(int index, string_view newName);
+
+		/** Rebuilds the name index from DirOrFiles. */
+		void rebuildNameIndex();
+
+		/** Writes the changed clusters of every directory modified since the last call, each cluster once. */
+		static void flushAll();
 
         string getFullPath() const ;
 
@@ -48,4 +69,70 @@ class Directory : public Directory_Entry {
 		string getDrive() const;
         bool isEmpty() const;
 
+		/** Estimated bytes this object holds, used by the dentry cache to bound its memory. */
+		size_t getMemoryUsage() const;
+
+	private:
+		/** Case-folded lookup key: the packed 8+3 name as getName() prints it (at most 12 characters), in lower case. */
+		struct NameKey
+		{
+			char text[12];
+			unsigned char length;
+
+			bool operator==(const NameKey& other) const;
+		};
+
+		/** Folded key of each entry, parallel to DirOrFiles. */
+		vector<NameKey> nameKeys;
+
+		/** Open-addressing table (linear probing) of positions in DirOrFiles, -1 for an empty slot.
+			Its size is a power of two at least twice the number of entries. */
+		vector<int> nameIndex;
+
+		/** Builds the key of a packed entry name, or of a name as typed (false if it is too long to match any entry). */
+		static NameKey makeKey(const Directory_Entry& entry);
+		static bool makeKey(string_view name, NameKey& key);
+
+		static size_t hashKey(const NameKey& key);
+
+		/** Returns the position of the entry with the given key, or -1. */
+		int findKey(const NameKey& key) const;
+
+		/** Adds DirOrFiles[position] to the index, growing the table when it gets half full. */
+		void indexEntry(int position);
+
+		/** Size of one on-disk directory entry. */
+		static const int SLOT_SIZE = sizeof(Directory_Slot);
+
+		/** On-disk slot of each entry (parallel to DirOrFiles), the tombstoned slots addEntry reuses,
+			and the number of slots up to the end of the directory, tombstones included. */
+		vector<int> entrySlots;
+		vector<int> freeSlots;
+		int slotCount = 0;
+
+		/** Positions in the chain of the clusters of clusterBuffer that changed since the last flush. */
+		vector<int> dirtyClusters;
+
+		/** Directories with dirty clusters, in the order they were first changed. */
+		static vector<Directory*> dirtyDirectories;
+
+		/** Records that the cluster at the given position in the chain must be written. */
+		void markClusterDirty(int position);
+
+		/** Writes this directory's dirty clusters, skipping any whose bytes turn out unchanged. */
+		void flush();
+
+		/** False when DirOrFiles was changed directly (pending entries aside), so slot positions are unknown and the
+			whole directory must be rewritten. */
+		bool slotsMatchEntries(size_t pending = 0) const;
+
+		/** Grows the chain to hold the given number of slots, with the new clusters zeroed; false if the disk is full. */
+		bool reserveSlots(int slots);
+
+		/** Writes one entry into its slot (nullptr removes it), marking only the cluster that holds the slot dirty. */
+		void writeSlot(int slot, const Directory_Entry* entry);
+
+		/** Tells the parent about this directory's new first cluster; does nothing if it did not change. */
+		void updateParent(int oldFirstCluster);
+
 	};
@@ -1,31 +1,50 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 using namespace std;
 
 class Directory;
 
+/** One directory entry, laid out exactly like its 32-byte on-disk slot and trivially copyable, so the entry arrays of a
+    directory are copied, moved and scanned as plain memory. Nothing else lives in an entry: file data stays in the
+    file's clusters, except that a file of at most INLINE_CAPACITY bytes keeps it in dir_empty, and loaded
+    subdirectories are owned by Dentry_Cache. */
 class Directory_Entry
 {
 public:
     Directory_Entry();
-    Directory_Entry(string name, char attr, int firstCluster);
-    void assignFileName(string name, string extension);
-    void assignDir_Name(string name);
+    Directory_Entry(string_view name, char attr, int firstCluster);
+    void assignFileName(string_view name, string_view extension);
+    void assignDir_Name(string_view name);
     char dir_name[11];
     char dir_attr;
+    /** Reserved bytes, blank in most entries; an inline file keeps its data here, from the first byte. */
     char dir_empty[12];
     int dir_firstCluster;
     int dir_fileSize;
-    Directory* subDirectory;
-    static string cleanTheName(string s);
+    /** Returns name without surrounding spaces, or an empty name if it has invalid characters or is too long. */
+    static string_view cleanTheName(string_view name);
     string getName() const;
+    /** Whether the entry is a file, which is whether the directory bit (0x10) of dir_attr is clear. */
     bool getIsFile() const;
+    /** Clears or sets the directory bit of dir_attr. */
     void setIsFile(bool isFile);
-    string getContent() const;
-    void setContent(const string& content);
-    bool isFile;
-    string content;
     int getSize() const;
 
+    /** Most bytes of file data an entry holds itself; a file that fits has no clusters and costs no extra read. */
+    static constexpr int INLINE_CAPACITY = 12;
+    /** Attribute bit (unused by FAT) marking a file whose data is stored in dir_empty. Entries written before inline
+        data existed never carry it, whatever their size and first cluster say. */
+    static constexpr char INLINE_ATTR = 0x40;
+    /** Whether the entry is a file whose data is stored inline in dir_empty. */
+    bool isInline() const;
+    /** Sets or clears INLINE_ATTR. */
+    void setInline(bool isInline);
+
 };
+
+static_assert(sizeof(Directory_Entry) == 32, "a directory entry is exactly one on-disk slot");
+static_assert(sizeof(Directory_Entry::dir_empty) == Directory_Entry::INLINE_CAPACITY, "inline data fills the reserved bytes");
+static_assert(is_trivially_copyable_v<Directory_Entry>, "directory entries are copied as plain memory");
@@ -1,157 +1,428 @@
 #include "File_Entry.h"
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
-File_Entry::File_Entry(string name, char dir_attr, int dir_firstCluster, Directory* pa)
-    : Directory_Entry(name, dir_attr, dir_firstCluster) , content("")
+vector<char> File_Entry::clusterBuffer;
+vector<char> File_Entry::transferBuffer;
+vector<int> File_Entry::runClusters;
+
+File_Entry::File_Entry(string_view name, char dir_attr, int dir_firstCluster, Directory* pa)
+    : Directory_Entry(name, dir_attr, dir_firstCluster) , parent(pa)
+{
+}
+
+File_Entry :: File_Entry(const Directory_Entry& d,Directory * pa)
+    :Directory_Entry (d), parent(pa)
+{
+}
+
+int File_Entry::getMySizeOnDisk()
 {
-    if (pa != nullptr)
+    return Mini_FAT::getChainLength(dir_firstCluster);
+}
+
+void File_Entry::emptyMyClusters()
+{
+    // freeChain stops at the end of the chain and never touches the superblock, even for a bad first cluster
+    if (dir_firstCluster != 0)
+        Mini_FAT::freeChain(dir_firstCluster);
+    invalidateIndex();
+}
+
+Directory_Entry File_Entry::getDirectory_Entry()
+{
+    // The entry is a plain 32-byte record, so the file's own copy of it is returned as is
+    return *this;
+}
+
+void File_Entry::deleteFile()
+{
+    emptyMyClusters();
+    if (parent != nullptr)
     {
-        parent = pa;
+        parent->removeEntry(getDirectory_Entry());
     }
 }
 
-File_Entry :: File_Entry(Directory_Entry d,Directory * pa)
-    :Directory_Entry (d.dir_name, d.dir_attr, d.dir_firstCluster)
+long long File_Entry::clustersFor(long long size)
+{
+    long long clusterSize = Mini_FAT::getClusterSize();
+    return (size + clusterSize - 1) / clusterSize;
+}
+
+long long File_Entry::clustersOnDisk(long long size)
 {
-    for (size_t i = 0; i < 12; i++)
+    return size <= INLINE_CAPACITY ? 0 : clustersFor(size);
+}
+
+void File_Entry::buildIndex()
+{
+    extents.clear();
+    indexedClusters = 0;
+    lastExtent = 0;
+    // The step cap guards against cycles, as the FAT's own chain walks do
+    int cluster = dir_firstCluster;
+    for (int steps = 0; cluster > 0 && steps < Virtual_Disk::getClusterCount(); steps++)
     {
-        dir_empty[i] = d.dir_empty[i];
+        if (!extents.empty() && extents.back().firstCluster + extents.back().length == cluster)
+            extents.back().length++;
+        else
+            extents.push_back(Extent{ indexedClusters, cluster, 1 });
+        indexedClusters++;
+        cluster = Mini_FAT::getClusterPointer(cluster);
     }
-    dir_fileSize = d.dir_fileSize;
-    content = "";
-    if (pa != nullptr)
+    indexValid = true;
+}
+
+void File_Entry::extendIndex(span<const int> clusters)
+{
+    if (!indexValid)
+        return;
+    for (int cluster : clusters)
     {
-       this -> parent = pa;
+        if (!extents.empty() && extents.back().firstCluster + extents.back().length == cluster)
+            extents.back().length++;
+        else
+            extents.push_back(Extent{ indexedClusters, cluster, 1 });
+        indexedClusters++;
     }
 }
 
-int File_Entry::getMySizeOnDisk()
+void File_Entry::invalidateIndex()
 {
-    int size = 0;
-    if (dir_firstCluster != 0)
+    indexValid = false;
+    extents.clear();
+    indexedClusters = 0;
+    lastExtent = 0;
+    cursorIndex = -1;
+}
+
+int File_Entry::clusterAt(long long index)
+{
+    if (!indexValid)
     {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
+        int cluster = -1;
+        if (index == 0)
+            cluster = dir_firstCluster > 0 ? dir_firstCluster : -1;
+        else if (index == cursorIndex + 1 && cursorIndex >= 0)
+            cluster = Mini_FAT::getClusterPointer(cursorCluster);
+        else
+            buildIndex();
+        if (!indexValid)
         {
-            size++;
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
+            cursorIndex = cluster > 0 ? index : -1;
+            cursorCluster = cluster;
+            return cluster > 0 ? cluster : -1;
+        }
     }
-    return size;
-}
+    if (index < 0 || index >= indexedClusters)
+        return -1;
 
-void File_Entry::emptyMyClusters()
-{
-    if (dir_firstCluster != 0)
+    auto contains = [index](const Extent& extent) {
+        return index >= extent.firstIndex && index < extent.firstIndex + extent.length;
+    };
+    if (lastExtent >= extents.size() || !contains(extents[lastExtent]))
     {
-        int cluster = dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        do
+        if (lastExtent + 1 < extents.size() && contains(extents[lastExtent + 1]))
+            lastExtent++;
+        else
         {
-            Mini_FAT::setClusterPointer(cluster, 0);
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
+            // The extents are sorted by firstIndex; the one holding index is the last that starts at or before it
+            auto it = upper_bound(extents.begin(), extents.end(), index,
+                [](long long value, const Extent& extent) { return value < extent.firstIndex; });
+            lastExtent = static_cast<size_t>(it - extents.begin()) - 1;
+        }
     }
+    const Extent& extent = extents[lastExtent];
+    return extent.firstCluster + static_cast<int>(index - extent.firstIndex);
 }
 
-Directory_Entry File_Entry::getDirectory_Entry()
+long long File_Entry::reserveClusters(long long count)
 {
-    Directory_Entry M(dir_name, dir_attr, dir_firstCluster);
-    for (size_t i = 0; i < 12; i++)
+    if (count <= 0)
+        return 0;
+    if (dir_firstCluster == 0)
+    {
+        // A new chain goes near the parent directory
+        vector<int> chain = Mini_FAT::allocateChain(static_cast<int>(count), parent != nullptr ? parent->dir_firstCluster : -1);
+        if (!chain.empty())
+            dir_firstCluster = chain[0];
+        invalidateIndex();
+        return static_cast<long long>(chain.size());
+    }
+    if (count == 1)
+        return 1;
+
+    // The index knows the length and the last cluster, so appending does not walk the chain
+    if (!indexValid)
+        buildIndex();
+    long long length = indexedClusters;
+    if (length >= count)
+        return length;
+
+    // Only the missing tail is allocated, right after the current last cluster when that space is free
+    int last = clusterAt(length - 1);
+    vector<int> tail = Mini_FAT::allocateChain(static_cast<int>(count - length), last + 1);
+    if (!tail.empty())
     {
-        M.dir_empty[i] = dir_empty[i];
+        Mini_FAT::setClusterPointer(last, tail[0]);
+        extendIndex(tail);
     }
-    M.dir_fileSize = dir_fileSize;
-    return M;
+    return length + static_cast<long long>(tail.size());
 }
 
-void File_Entry::writeFileContent()
+bool File_Entry::moveInlineToCluster()
 {
-    Directory_Entry A = this->getDirectory_Entry();
-    if (!content.empty())
+    // The data goes to the start of a new first cluster, and the entry's reserved bytes go back to blanks
+    size_t stored = static_cast<size_t>(min(dir_fileSize, INLINE_CAPACITY));
+    char data[INLINE_CAPACITY];
+    memcpy(data, dir_empty, stored);
+    if (reserveClusters(1) < 1)
+        return false;
+    clusterBuffer.assign(static_cast<size_t>(Mini_FAT::getClusterSize()), 0);
+    memcpy(clusterBuffer.data(), data, stored);
+    Virtual_Disk::writeCluster(clusterBuffer, dir_firstCluster, ClusterUse::FileData);
+    setInline(false);
+    fill(begin(dir_empty), end(dir_empty), ' ');
+    return true;
+}
+
+void File_Entry::updateParent(const Directory_Entry& before)
+{
+    // Inline data changes the entry too, so the whole record is compared
+    if (parent != nullptr && memcmp(&before, static_cast<const Directory_Entry*>(this), sizeof(Directory_Entry)) != 0)
+        parent->updatecontent(before, getDirectory_Entry());
+}
+
+size_t File_Entry::read(long long offset, span<char> out)
+{
+    if (offset < 0 || offset >= dir_fileSize || out.empty())
+        return 0;
+    size_t wanted = static_cast<size_t>(min<long long>(static_cast<long long>(out.size()), dir_fileSize - offset));
+    if (isInline())
+    {
+        // Inline data is already in memory, read along with the directory
+        size_t stored = offset < INLINE_CAPACITY ? static_cast<size_t>(INLINE_CAPACITY - offset) : 0;
+        size_t piece = min(wanted, stored);
+        memcpy(out.data(), dir_empty + offset, piece);
+        return piece;
+    }
+    size_t clusterSize = static_cast<size_t>(Mini_FAT::getClusterSize());
+    clusterBuffer.resize(clusterSize);
+
+    int cluster = clusterAt(offset / static_cast<long long>(clusterSize));
+    size_t done = 0;
+    while (done < wanted && cluster > 0)
     {
-        vector<char> contentBYTES = Converter::StringToBytes(content);
-        vector<vector<char>> bytesList = Converter::splitBytes(contentBYTES);
-        int clusterFATIndex;
-        if (dir_firstCluster != 0)
+        size_t within = static_cast<size_t>((offset + static_cast<long long>(done)) % static_cast<long long>(clusterSize));
+        size_t piece = min(clusterSize - within, wanted - done);
+        if (piece == clusterSize)
         {
-            emptyMyClusters();
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            dir_firstCluster = clusterFATIndex;
+            // Whole clusters go straight into the caller's buffer, gathered into one readClusters call: one read per
+            // run of consecutive clusters, all in flight together in Async mode
+            size_t start = done;
+            runClusters.clear();
+            runClusters.push_back(cluster);
+            done += piece;
+            for (int next; wanted - done >= clusterSize && (next = Mini_FAT::getClusterPointer(cluster)) > 0; done += piece)
+            {
+                cluster = next;
+                runClusters.push_back(cluster);
+            }
+            Virtual_Disk::readClusters(runClusters, out.subspan(start, done - start));
         }
         else
         {
-            clusterFATIndex = Mini_FAT::getAvailableCluster();
-            if (clusterFATIndex != 0)
-                this->dir_firstCluster = clusterFATIndex;
+            Virtual_Disk::readCluster(cluster, clusterBuffer, ClusterUse::FileData);
+            memcpy(out.data() + done, clusterBuffer.data() + within, piece);
+            done += piece;
         }
-        int lastCluster = -1;
-        for (int i = 0; i < bytesList.size(); i++)
+        if (done < wanted)
+            cluster = Mini_FAT::getClusterPointer(cluster);
+    }
+    return done;
+}
+
+size_t File_Entry::write(long long offset, span<const char> data)
+{
+    if (offset < 0 || data.empty())
+        return 0;
+    if (offset > dir_fileSize && !truncate(offset))
+        return 0;
+
+    Directory_Entry before = getDirectory_Entry();
+    long long clusterSize = Mini_FAT::getClusterSize();
+    long long end = offset + static_cast<long long>(data.size());
+    if ((isInline() || (dir_firstCluster == 0 && dir_fileSize == 0)) && end <= INLINE_CAPACITY)
+    {
+        // A file that still fits in its entry keeps its data there: no cluster, and only the directory slot changes
+        setInline(true);
+        memcpy(dir_empty + offset, data.data(), data.size());
+        dir_fileSize = static_cast<int>(max<long long>(dir_fileSize, end));
+        updateParent(before);
+        return data.size();
+    }
+    if (isInline() && !moveInlineToCluster())
+        return 0;
+    long long available = reserveClusters(clustersFor(end)) * clusterSize;
+    size_t writable = available > offset ? static_cast<size_t>(min(end, available) - offset) : 0;
+    clusterBuffer.resize(static_cast<size_t>(clusterSize));
+
+    int cluster = writable > 0 ? clusterAt(offset / clusterSize) : -1;
+    size_t done = 0;
+    while (done < writable && cluster > 0)
+    {
+        long long position = offset + static_cast<long long>(done);
+        size_t within = static_cast<size_t>(position % clusterSize);
+        size_t piece = min(static_cast<size_t>(clusterSize) - within, writable - done);
+        if (piece == static_cast<size_t>(clusterSize))
         {
-            if (clusterFATIndex != -1)
+            // Whole clusters are gathered into one writeChain call, as read() does; inside a transaction they are
+            // staged as file data, which is written in place rather than journaled
+            size_t start = done;
+            runClusters.clear();
+            runClusters.push_back(cluster);
+            done += piece;
+            for (int next; writable - done >= piece && (next = Mini_FAT::getClusterPointer(cluster)) > 0; done += piece)
             {
-                Virtual_Disk::writeCluster(bytesList[i], clusterFATIndex);
-                Mini_FAT::setClusterPointer(clusterFATIndex, -1);
-                if (lastCluster != -1)
-                    Mini_FAT::setClusterPointer(lastCluster, clusterFATIndex);
-                lastCluster = clusterFATIndex;
-                clusterFATIndex = Mini_FAT::getAvailableCluster();
+                cluster = next;
+                runClusters.push_back(cluster);
             }
+            Virtual_Disk::writeChain(runClusters, data.subspan(start, done - start), ClusterUse::FileData);
         }
+        else
+        {
+            // A partial cluster keeps the bytes around the piece; a cluster that starts at or past the old end holds
+            // nothing yet, so it is zero-filled instead of read
+            if (position - static_cast<long long>(within) < dir_fileSize)
+                Virtual_Disk::readCluster(cluster, clusterBuffer, ClusterUse::FileData);
+            else
+                fill(clusterBuffer.begin(), clusterBuffer.end(), 0);
+            memcpy(clusterBuffer.data() + within, data.data() + done, piece);
+            Virtual_Disk::writeCluster(clusterBuffer, cluster, ClusterUse::FileData);
+            done += piece;
+        }
+        if (done < writable)
+            cluster = Mini_FAT::getClusterPointer(cluster);
     }
-    if (content.empty())
+
+    dir_fileSize = static_cast<int>(max<long long>(dir_fileSize, offset + static_cast<long long>(done)));
+    updateParent(before);
+    return done;
+}
+
+size_t File_Entry::append(span<const char> data)
+{
+    return write(dir_fileSize, data);
+}
+
+bool File_Entry::truncate(long long size)
+{
+    if (size < 0)
+        return false;
+    if (size > dir_fileSize)
     {
-        if (dir_firstCluster != 0)
-            emptyMyClusters();
-        if (parent != nullptr)
-            dir_firstCluster = 0;
+        // The new bytes are written as zeros, so stale data in reused clusters never shows through
+        vector<char> zeros(static_cast<size_t>(Mini_FAT::getClusterSize()), 0);
+        while (dir_fileSize < size)
+        {
+            size_t piece = static_cast<size_t>(min<long long>(static_cast<long long>(zeros.size()), size - dir_fileSize));
+            if (write(dir_fileSize, span<const char>(zeros.data(), piece)) < piece)
+                return false;
+        }
+        return true;
     }
-    Directory_Entry B = getDirectory_Entry();
-    if (parent != nullptr)
+
+    Directory_Entry before = getDirectory_Entry();
+    long long keep = clustersFor(size);
+    if (isInline())
     {
-        parent->updatecontent(A, B);
-        parent->writeDirectory();
+        // Inline data: the bytes past the new end go back to blanks, and an emptied file is a plain entry again
+        fill(dir_empty + min<long long>(size, INLINE_CAPACITY), end(dir_empty), ' ');
+        setInline(size > 0);
     }
-
-    Mini_FAT::writeFAT();
+    else if (dir_firstCluster == 0)
+    {
+        // No data is stored (an entry from an older image that recorded only a size), so only the size changes
+    }
+    else if (size <= INLINE_CAPACITY)
+    {
+        // A file that now fits in its entry moves what is left into it and gives up its clusters
+        char kept[INLINE_CAPACITY];
+        size_t got = read(0, span<char>(kept, static_cast<size_t>(size)));
+        emptyMyClusters();
+        dir_firstCluster = 0;
+        fill(begin(dir_empty), end(dir_empty), ' ');
+        memcpy(dir_empty, kept, got);
+        setInline(got > 0);
+        size = static_cast<long long>(got);
+    }
+    else
+    {
+        int last = clusterAt(keep - 1);
+        if (last > 0)
+        {
+            int next = Mini_FAT::getClusterPointer(last);
+            Mini_FAT::setClusterPointer(last, -1);
+            if (next > 0)
+            {
+                Mini_FAT::freeChain(next);
+                invalidateIndex();
+            }
+        }
+    }
+    dir_fileSize = static_cast<int>(size);
+    updateParent(before);
+    return true;
 }
 
-void File_Entry::readFileContent()
+long long File_Entry::streamTo(ostream& out)
 {
-    if (dir_firstCluster != 0)
+    vector<char>& chunk = transferBuffer;
+    chunk.resize(static_cast<size_t>(TRANSFER_CLUSTERS) * Mini_FAT::getClusterSize());
+    long long offset = 0;
+    while (size_t count = read(offset, chunk))
     {
-        content = "";
-        int cluster = this->dir_firstCluster;
-        int next = Mini_FAT::getClusterPointer(cluster);
-        vector<char> ls;
-        do
-        {
-            vector<char> clusterData = Virtual_Disk::readCluster(cluster);
-            ls.insert(ls.end(), clusterData.begin(), clusterData.end());
-            cluster = next;
-            if (cluster != -1)
-                next = Mini_FAT::getClusterPointer(cluster);
-        } while (cluster != -1);
-
-        content = Converter::BytesToString(ls);
+        out.write(chunk.data(), static_cast<streamsize>(count));
+        offset += static_cast<long long>(count);
     }
+    return offset;
 }
 
-void File_Entry::deleteFile()
+long long File_Entry::streamFrom(istream& in)
 {
-    emptyMyClusters();
-    if (parent != nullptr)
+    vector<char>& chunk = transferBuffer;
+    chunk.resize(static_cast<size_t>(TRANSFER_CLUSTERS) * Mini_FAT::getClusterSize());
+    long long offset = 0;
+    while (in)
     {
-        parent->removeEntry(getDirectory_Entry());
+        in.read(chunk.data(), static_cast<streamsize>(chunk.size()));
+        size_t count = static_cast<size_t>(in.gcount());
+        if (count == 0)
+            break;
+        size_t written = write(offset, span<const char>(chunk.data(), count));
+        offset += static_cast<long long>(written);
+        if (written < count)
+            break;
     }
+    // Whatever the old content had past the new end is dropped
+    truncate(offset);
+    return offset;
 }
 
-void File_Entry::printContent()
+long long File_Entry::copyFrom(File_Entry& source)
 {
-    cout << "\n" << dir_name << "\n\n" << content << "\n" << endl;
+    vector<char>& chunk = transferBuffer;
+    chunk.resize(static_cast<size_t>(TRANSFER_CLUSTERS) * Mini_FAT::getClusterSize());
+    long long offset = 0;
+    while (size_t count = source.read(offset, chunk))
+    {
+        size_t written = write(offset, span<const char>(chunk.data(), count));
+        offset += static_cast<long long>(written);
+        if (written < count)
+            break;
+    }
+    truncate(offset);
+    return offset;
 }
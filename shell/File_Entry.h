@@ -1,18 +1,20 @@
 #pragma once
 #include "Directory.h"
 #include"Directory_Entry.h"
+#include<iostream>
+#include<span>
 #include<string>
+#include<vector>
 using namespace std;
 
 class File_Entry : public Directory_Entry
 {
 public:
-    string content;
     Directory* parent;
     
-    File_Entry(string name, char dir_attr, int dir_firstCluster, Directory* pa);
+    File_Entry(string_view name, char dir_attr, int dir_firstCluster, Directory* pa);
 
-    File_Entry(Directory_Entry d, Directory* pa);
+    File_Entry(const Directory_Entry& d, Directory* pa);
 
     int getMySizeOnDisk();
 
@@ -20,11 +22,101 @@ public:
 
     Directory_Entry getDirectory_Entry();
 
-    void writeFileContent();
+    void deleteFile();
 
-    void readFileContent();
+    /** Reads up to out.size() bytes starting at offset, stopping at the end of the file; returns the number of bytes read.
+        Whole clusters are read straight into out in one batch; only a partly read cluster goes through the cache. */
+    size_t read(long long offset, span<char> out);
 
-    void deleteFile();
+    /** Writes data at offset, allocating clusters at the end of the chain as needed; writing past the end of the file
+        first fills the gap with zeros. A file of at most INLINE_CAPACITY bytes is kept in its entry instead. Returns
+        the number of bytes written, fewer than data.size() if the disk fills up. */
+    size_t write(long long offset, span<const char> data);
+
+    /** Writes data at the end of the file; returns the number of bytes written. */
+    size_t append(span<const char> data);
+
+    /** Sets the file size: shrinking frees the clusters past the new end, and all of them once the rest fits in the
+        entry; growing fills the new bytes with zeros. Returns false if the disk filled up while growing. */
+    bool truncate(long long size);
+
+    /** Writes the whole file to out, TRANSFER_CLUSTERS at a time; returns the number of bytes written. */
+    long long streamTo(ostream& out);
+
+    /** Replaces the content with everything read from in, TRANSFER_CLUSTERS at a time, reusing the clusters already
+        in the chain; returns the number of bytes stored, which stops short if the disk fills up. */
+    long long streamFrom(istream& in);
+
+    /** Replaces the content with a copy of source's, TRANSFER_CLUSTERS at a time; returns the number of bytes copied. */
+    long long copyFrom(File_Entry& source);
+
+    /** Number of clusters a file of size bytes takes. */
+    static long long clustersFor(long long size);
+
+    /** Number of clusters a file of size bytes takes on disk: none when it fits in its entry. */
+    static long long clustersOnDisk(long long size);
+
+private:
+    /** One cluster of data for partial-cluster reads and writes, shared by every File_Entry so opening a file does
+        not allocate one. Reads and writes never nest, so one buffer is enough. */
+    static vector<char> clusterBuffer;
+
+    /** Clusters that streamTo, streamFrom and copyFrom move per read or write call, so each call hands the disk
+        several runs at once (queued together on the ring in Async mode). */
+    static constexpr int TRANSFER_CLUSTERS = 16;
+
+    /** Chunk buffer of streamTo, streamFrom and copyFrom, kept apart from clusterBuffer, which the write of each
+        chunk uses. */
+    static vector<char> transferBuffer;
+
+    /** The whole clusters one read or write call passes to Virtual_Disk together; reused like the buffers above. */
+    static vector<int> runClusters;
+
+    /** A run of consecutive clusters of the chain: the chain's firstIndex-th cluster is firstCluster, and the run
+        has length clusters. */
+    struct Extent
+    {
+        long long firstIndex;
+        int firstCluster;
+        int length;
+    };
+
+    /** Index of the chain as runs, built on first use by a single walk of the FAT, so seeking anywhere in the file does
+        not walk the chain again. It belongs to this handle: growing the file extends it, and any other change to the
+        chain drops it, to be rebuilt on the next access. */
+    vector<Extent> extents;
+    long long indexedClusters = 0;
+    bool indexValid = false;
+
+    /** The extent the last lookup landed in; sequential access checks it and the next one before searching. */
+    size_t lastExtent = 0;
+
+    /** The chain's cursorIndex-th cluster is cursorCluster, as last found without the index. Asking for the next
+        cluster follows one FAT link from it, so reading a file front to back never builds the index. */
+    long long cursorIndex = -1;
+    int cursorCluster = 0;
+
+    /** Walks the chain once and records it as extents. */
+    void buildIndex();
+
+    /** Adds clusters linked at the end of the chain to a valid index. */
+    void extendIndex(span<const int> clusters);
+
+    void invalidateIndex();
+
+    /** Returns the index-th cluster of the chain, or -1 if the chain is shorter. The first cluster is answered from
+        the entry itself and the one after the cursor from the FAT, so small files and sequential reads never build
+        the index. */
+    int clusterAt(long long index);
+
+    /** Makes the chain at least count clusters long; returns how many clusters are known to exist, which is at least
+        count unless the disk filled up. */
+    long long reserveClusters(long long count);
+
+    /** Moves inline data to a newly allocated first cluster before the file outgrows its entry; false if the disk is
+        full, leaving the file as it was. */
+    bool moveInlineToCluster();
 
-    void printContent();
+    /** Writes this entry back to the parent directory if it differs from before. */
+    void updateParent(const Directory_Entry& before);
 };
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "Journal.h"
+#include "Converter.h"
+#include "Virtual_Disk.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+int Journal::firstCluster = 0;
+int Journal::clusterCount = 0;
+int Journal::head = 0;
+unsigned Journal::nextSequence = 1;
+
+// Record layout, 32-bit little-endian fields, followed by the cluster images in the same order as the list:
+//   0  magic "MJNL"
+//   4  sequence number
+//   8  cluster count (0 for the empty record that starts a new generation)
+//  12  checksum of the sequence number, the count, the cluster list and the images
+//  16  cluster list, one index per cluster, zero-padded to whole clusters
+// Replay follows records from the start of the journal while each is complete and numbered one past the previous one;
+// anything after that was left by an earlier generation, whose records all have lower sequence numbers.
+static const char RECORD_MAGIC[4] = { 'M', 'J', 'N', 'L' };
+static const int RECORD_HEADER_SIZE = 16;
+
+static void putUInt32(char* bytes, unsigned value)
+{
+    int stored = static_cast<int>(value);
+    Converter::encodeInt32LE(span<const int>(&stored, 1), span<char>(bytes, 4));
+}
+
+static unsigned getUInt32(const char* bytes)
+{
+    int value = 0;
+    Converter::decodeInt32LE(span<const char>(bytes, 4), span<int>(&value, 1));
+    return static_cast<unsigned>(value);
+}
+
+static unsigned fnv1a(unsigned hash, const char* bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int Journal::clustersFor(int count)
+{
+    // About 3% of the volume: enough for the FAT clusters and directory clusters a typical command changes. Small
+    // volumes get at most an eighth of their clusters, so most of them stay data clusters; a record of one cluster
+    // needs two, and anything larger than the journal is written in place
+    return min(clamp(count / 32, 16, 4096), count / 8);
+}
+
+void Journal::open(int first, int count)
+{
+    firstCluster = first;
+    clusterCount = count;
+    head = 0;
+    nextSequence = 1;
+}
+
+bool Journal::isEnabled()
+{
+    return clusterCount > 0;
+}
+
+int Journal::headerClusters(int count)
+{
+    int clusterSize = Virtual_Disk::getClusterSize();
+    return (RECORD_HEADER_SIZE + 4 * count + clusterSize - 1) / clusterSize;
+}
+
+unsigned Journal::checksum(const char* header, size_t listSize, const vector<const char*>& images)
+{
+    unsigned hash = fnv1a(2166136261u, header + 4, 8);
+    hash = fnv1a(hash, header + RECORD_HEADER_SIZE, listSize);
+    for (const char* image : images)
+        hash = fnv1a(hash, image, Virtual_Disk::getClusterSize());
+    return hash;
+}
+
+int Journal::replay()
+{
+    if (!isEnabled())
+        return 0;
+
+    int clusterSize = Virtual_Disk::getClusterSize();
+    int dataStart = firstCluster + clusterCount;
+    map<int, vector<char>> latest;
+    int records = 0;
+    int position = 0;
+    vector<char> first(clusterSize);
+    while (position < clusterCount)
+    {
+        Virtual_Disk::readCluster(firstCluster + position, first);
+        if (memcmp(first.data(), RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0)
+            break;
+        unsigned sequence = getUInt32(first.data() + 4);
+        int count = static_cast<int>(getUInt32(first.data() + 8));
+        if (records > 0 && sequence != nextSequence)
+            break;
+        nextSequence = sequence;
+        if (count <= 0 || count > clusterCount)
+            break;
+        int recordClusters = headerClusters(count) + count;
+        if (position + recordClusters > clusterCount)
+            break;
+
+        // The whole record is contiguous, so it is read in one go
+        vector<int> clusters(recordClusters);
+        for (int i = 0; i < recordClusters; i++)
+            clusters[i] = firstCluster + position + i;
+        vector<char> record(static_cast<size_t>(recordClusters) * clusterSize);
+        Virtual_Disk::readClusters(clusters, record);
+
+        const char* images = record.data() + static_cast<size_t>(headerClusters(count)) * clusterSize;
+        vector<const char*> imagePointers(count);
+        bool valid = true;
+        for (int i = 0; i < count; i++)
+        {
+            int target = static_cast<int>(getUInt32(record.data() + RECORD_HEADER_SIZE + 4 * i));
+            if (target < 0 || target >= Virtual_Disk::getClusterCount() || (target >= firstCluster && target < dataStart))
+                valid = false;
+            imagePointers[i] = images + static_cast<size_t>(i) * clusterSize;
+        }
+        // A torn record, where the crash came before its flush completed, ends the replay
+        if (!valid || checksum(record.data(), 4 * static_cast<size_t>(count), imagePointers) != getUInt32(record.data() + 12))
+            break;
+
+        // Later records win over earlier ones for the same cluster
+        for (int i = 0; i < count; i++)
+        {
+            int target = static_cast<int>(getUInt32(record.data() + RECORD_HEADER_SIZE + 4 * i));
+            latest[target].assign(imagePointers[i], imagePointers[i] + clusterSize);
+        }
+        records++;
+        nextSequence = sequence + 1;
+        position += recordClusters;
+    }
+
+    for (const auto& [target, image] : latest)
+        Virtual_Disk::writeCluster(image, target);
+    Virtual_Disk::sync();
+    if (records > 0)
+        writeEmptyHeader();
+    head = 0;
+    return records;
+}
+
+void Journal::commit(const map<int, vector<char>>& clusters)
+{
+    if (clusters.empty())
+        return;
+
+    int clusterSize = Virtual_Disk::getClusterSize();
+    int count = static_cast<int>(clusters.size());
+    int recordClusters = headerClusters(count) + count;
+    if (recordClusters > clusterCount)
+    {
+        // Too big to log: nothing already logged may be replayed over it, so the journal is emptied first,
+        // and the data area is made durable before the FAT that refers to it
+        checkpoint();
+        int dataStart = firstCluster + clusterCount;
+        writeInPlace(clusters, dataStart, Virtual_Disk::getClusterCount());
+        Virtual_Disk::sync();
+        writeInPlace(clusters, 0, dataStart);
+        Virtual_Disk::sync();
+        return;
+    }
+    if (head + recordClusters > clusterCount)
+        checkpoint();
+
+    // Header, cluster list and images are written as one run and flushed once; the buffers are kept between commits
+    // (the record never outgrows the journal)
+    static vector<char> record;
+    static vector<const char*> imagePointers;
+    static vector<int> journalClusters;
+    record.assign(static_cast<size_t>(recordClusters) * clusterSize, 0);
+    memcpy(record.data(), RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    putUInt32(record.data() + 4, nextSequence);
+    putUInt32(record.data() + 8, static_cast<unsigned>(count));
+    char* images = record.data() + static_cast<size_t>(headerClusters(count)) * clusterSize;
+    imagePointers.clear();
+    int i = 0;
+    for (const auto& [target, image] : clusters)
+    {
+        putUInt32(record.data() + RECORD_HEADER_SIZE + 4 * i, static_cast<unsigned>(target));
+        memcpy(images + static_cast<size_t>(i) * clusterSize, image.data(), clusterSize);
+        imagePointers.push_back(images + static_cast<size_t>(i) * clusterSize);
+        i++;
+    }
+    putUInt32(record.data() + 12, checksum(record.data(), 4 * static_cast<size_t>(count), imagePointers));
+
+    journalClusters.resize(recordClusters);
+    for (int j = 0; j < recordClusters; j++)
+        journalClusters[j] = firstCluster + head + j;
+    Virtual_Disk::writeChain(journalClusters, record);
+    Virtual_Disk::syncClusters(firstCluster + head, recordClusters);
+    head += recordClusters;
+    nextSequence++;
+
+    // The record is durable, so the home copies can wait in the write-back cache
+    for (const auto& [target, image] : clusters)
+        Virtual_Disk::writeCluster(image, target);
+}
+
+void Journal::writeInPlace(const map<int, vector<char>>& clusters, int from, int to)
+{
+    // One writeChain call, which writes each run of consecutive clusters at once
+    vector<int> targets;
+    vector<char> images;
+    for (auto it = clusters.lower_bound(from); it != clusters.end() && it->first < to; ++it)
+    {
+        targets.push_back(it->first);
+        images.insert(images.end(), it->second.begin(), it->second.end());
+    }
+    if (!targets.empty())
+        Virtual_Disk::writeChain(targets, images);
+}
+
+void Journal::checkpoint()
+{
+    if (!isEnabled() || head == 0)
+        return;
+    Virtual_Disk::sync();
+    writeEmptyHeader();
+    head = 0;
+}
+
+void Journal::close()
+{
+    checkpoint();
+    clusterCount = 0;
+}
+
+void Journal::writeEmptyHeader()
+{
+    vector<char> header(Virtual_Disk::getClusterSize(), 0);
+    memcpy(header.data(), RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    putUInt32(header.data() + 4, nextSequence);
+    putUInt32(header.data() + 12, checksum(header.data(), 0, {}));
+    int cluster = firstCluster;
+    Virtual_Disk::writeChain(span<const int>(&cluster, 1), header);
+    Virtual_Disk::syncClusters(firstCluster, 1);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <map>
+#include <vector>
+using namespace std;
+
+/** Write-ahead journal kept in a fixed run of clusters between the FAT and the data area. A commit logs every metadata
+    cluster it changed (superblock, FAT, directories; file data is written in place and synced first) as one
+    checksummed record and makes it durable with a single flush; the clusters are then written to their home
+    locations through the write-back cache without a flush of their own, and only have to reach the file when the
+    journal fills up (a checkpoint) or the disk is closed. Records left by a crash are replayed when the disk is opened. */
+class Journal
+{
+public:
+    /** Number of journal clusters given to a new volume of clusterCount clusters, never more than an eighth of it. */
+    static int clustersFor(int clusterCount);
+
+    /** Uses the clusterCount clusters from firstCluster as the journal; a count of 0 leaves journaling off (images
+        created before the journal existed). Does not read the region; call replay() for an existing image. */
+    static void open(int firstCluster, int clusterCount);
+
+    /** Writes the clusters of every complete record to their home locations, syncs, and empties the journal.
+        Must run before anything else is read from the image. Returns the number of records applied. */
+    static int replay();
+
+    static bool isEnabled();
+
+    /** Logs the given clusters (by index) as one record, flushes once, and then writes them home lazily. A commit
+        larger than the whole journal is written in place instead, data area first, after a checkpoint. */
+    static void commit(const map<int, vector<char>>& clusters);
+
+    /** Makes every home write durable and empties the journal, so no record is replayed over later writes. */
+    static void checkpoint();
+
+    /** Checkpoints and turns journaling off, before the disk is closed. */
+    static void close();
+
+private:
+    /** First journal cluster, number of journal clusters, and where the next record goes (relative to firstCluster). */
+    static int firstCluster;
+    static int clusterCount;
+    static int head;
+
+    /** Sequence number of the next record; records of one journal generation are numbered consecutively. */
+    static unsigned nextSequence;
+
+    /** Number of clusters the header of a record of count clusters takes. */
+    static int headerClusters(int count);
+
+    /** Checksum of a record: FNV-1a over the sequence number and count in header, the listSize bytes of cluster list
+        after them, and the cluster images. */
+    static unsigned checksum(const char* header, size_t listSize, const vector<const char*>& images);
+
+    /** Writes the given clusters in [from, to) straight to their home locations. */
+    static void writeInPlace(const map<int, vector<char>>& clusters, int from, int to);
+
+    /** Writes an empty record at the start of the journal that carries the next sequence number, and flushes it. */
+    static void writeEmptyHeader();
+};
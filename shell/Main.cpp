@@ -7,21 +7,122 @@
 #include "Parser.h"
 #include "CommandHandler.h"
 #include "Converter.h"
+#include "Alloc_Counter.h"
+#include "Codec_Bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 using namespace std;
 
-int main()
+// Commands checked by --check-allocations: the read-only ones, and a write that rewrites a small file in place with
+// text of the same length. The list ends in the root, where it starts, so a second pass repeats the first exactly
+static const char* const CHECKED_COMMANDS[] = {
+    "dir", "dir docs", "cd docs", "dir", "type small.txt", "cd ..", "type small.txt", "type big.txt",
+    "type docs\\small.txt", "cd C:\\docs", "cd C:\\", "write small.txt"
+};
+
+// What write reads from the console in each pass
+static const char WRITE_INPUT[] = "Rewritten in place, same length.\nEND\n";
+
+// The allocation check of a counting build, run on the scratch disk just opened: a few files are imported, the
+// checked commands run once to warm the caches, and none of them may allocate when run again. Returns the exit status
+static int checkAllocations(CommandHandler& handler)
+{
+    if (!Alloc_Counter::isEnabled())
+    {
+        cout << "Error: --check-allocations needs a build with SHELL_COUNT_ALLOCATIONS defined.\n";
+        return 1;
+    }
+
+    // A file of one cluster and one of several, imported from a scratch folder on the host
+    filesystem::path files = filesystem::absolute("alloc_check_files");
+    filesystem::create_directories(files);
+    ofstream(files / "small.txt") << "A file that fits in one cluster.\n";
+    ofstream(files / "big.txt") << string(3 * Virtual_Disk::getClusterSize() + 100, 'x');
+    bool running = true;
+    handler.executeCommand("import \"" + files.string() + "\"", running);
+    handler.executeCommand("md docs", running);
+    handler.executeCommand("copy small.txt docs", running);
+    filesystem::remove_all(files);
+
+    // write takes its text from the console, so the console is fed from a string while the check runs
+    istringstream writeInput(string(WRITE_INPUT) + WRITE_INPUT);
+    streambuf* console = cin.rdbuf(writeInput.rdbuf());
+
+    int failures = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (const char* command : CHECKED_COMMANDS)
+        {
+            handler.executeCommand(command, running);
+            if (pass == 1 && handler.getLastAllocations() != 0)
+            {
+                cout << "Allocation check failed: '" << command << "' allocated " << handler.getLastAllocations()
+                    << " time(s) on a warm cache.\n";
+                failures++;
+            }
+        }
+    }
+    cin.rdbuf(console);
+    cout << (failures == 0 ? "Allocation check passed.\n" : "Allocation check failed.\n");
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
 {
     // Path to the virtual disk file
     string diskPath = "virtual_disk.bin";
 
-    // Step 1: Initialize or open the virtual disk and FAT system
-    Mini_FAT::initialize_Or_Open_FileSystem(diskPath);
+    // Optional geometry for a new disk: shell [--mode=mapped|stream|async] [clusterSize [clusterCount]]; an existing
+    // disk keeps its own geometry. The mode picks the I/O backend: the image mapped into memory (the default), the
+    // stream with the write-back cluster cache, or that cache with io_uring batches (POSIX only; falls back to stream).
+    // --check-allocations runs the allocation check of a counting build on a scratch disk instead of the shell, and
+    // --bench-codec times the directory slot codec without opening a disk
+    int clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+    int clusterCount = Virtual_Disk::DEFAULT_CLUSTER_COUNT;
+    DiskMode mode = DiskMode::Mapped;
+    bool allocationCheck = false;
+    vector<string> geometry;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--mode=mapped")
+            mode = DiskMode::Mapped;
+        else if (arg == "--mode=stream")
+            mode = DiskMode::Stream;
+        else if (arg == "--mode=async")
+            mode = DiskMode::Async;
+        else if (arg == "--check-allocations")
+            allocationCheck = true;
+        else if (arg == "--bench-codec")
+            return Codec_Bench::run();
+        else if (arg.rfind("--mode=", 0) == 0)
+            cout << "Warning: Unknown disk mode '" << arg.substr(7) << "'; using mapped.\n";
+        else
+            geometry.push_back(arg);
+    }
+    if (geometry.size() > 0)
+        clusterSize = atoi(geometry[0].c_str());
+    if (geometry.size() > 1)
+        clusterCount = atoi(geometry[1].c_str());
+    if (allocationCheck)
+    {
+        diskPath = "alloc_check.bin";
+        remove(diskPath.c_str());
+    }
+
+    // Step 1: Initialize or open the virtual disk and FAT system with the chosen backend
+    Mini_FAT::initialize_Or_Open_FileSystem(diskPath, mode, clusterSize, clusterCount);
+    if (Virtual_Disk::getMode() != mode)
+        cout << "Warning: The requested disk mode is not available here; using stream.\n";
 
     // Step 2: Create the root directory "C:\" and initialize its contents
-    Directory* rootDir = new Directory("C:", 0x10, 0, nullptr); // Create root directory with default values
+    Directory* rootDir = new Directory("C:", 0x10, Mini_FAT::getRootCluster(), nullptr); // Create root directory where the superblock says it starts
     rootDir->name = "C:"; // Assign the name "C:" to the root directory
     rootDir->readDirectory(); // Load directory entries from the virtual disk
 
@@ -30,6 +131,14 @@ int main()
 
     // Step 4: Initialize the command handler
     CommandHandler cmdHandler(&currentDir);
+    if (allocationCheck)
+    {
+        int status = checkAllocations(cmdHandler);
+        Mini_FAT::CloseTheSystem();
+        delete rootDir;
+        remove(diskPath.c_str());
+        return status;
+    }
 
     // Step 5: Display the welcome message
     cout << "  =========================================================================================================" << endl;
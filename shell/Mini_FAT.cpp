@@ -1,20 +1,84 @@
 #include "Mini_FAT.h"
 #include "Converter.h"
+#include "Journal.h"
 #include "virtual_Disk.h"
+#include <algorithm>
+#include <bit>
 #include <cstring>
+#include <iostream>
 using namespace std;
 
-int Mini_FAT::FAT[1024];  // FAT array representing cluster state
+vector<int> Mini_FAT::FAT;  // FAT array representing cluster state, one entry per cluster
 
-// Initializes the FAT array; sets reserved clusters to -1, free clusters to 0
+// Free-cluster bitmap mirroring the zero entries of FAT
+vector<uint64_t> Mini_FAT::freeBitmap;
+int Mini_FAT::freeCount = 0;
+int Mini_FAT::nextFitCursor = 0;
+
+// The FAT occupies clusters 1..fatClusterCount, right after the superblock
+int Mini_FAT::fatClusterCount = 0;
+int Mini_FAT::entriesPerFATCluster = 0;
+
+// The journal follows the FAT; images without one have a count of 0
+int Mini_FAT::journalClusterCount = 0;
+
+// First cluster of the root directory as recorded in the superblock (0 while the root is empty)
+int Mini_FAT::rootCluster = 0;
+
+// FAT clusters waiting to be written at the next commit point
+vector<bool> Mini_FAT::fatClusterDirty;
+
+// Superblock layout (cluster 0), 32-bit little-endian fields; the rest of the cluster is zero:
+//   0  magic "MFAT"
+//   4  format version
+//   8  cluster size in bytes
+//  12  cluster count
+//  16  first FAT cluster
+//  20  FAT cluster count
+//  24  first journal cluster (version 2)
+//  28  journal cluster count (version 2)
+//  32  first cluster of the root directory, 0 if it has none (version 2)
+// Images written before the geometry was recorded have an all-zero superblock and use the default geometry;
+// version 1 images have no journal and do not record the root directory; both read as 0.
+static const char SUPERBLOCK_MAGIC[4] = { 'M', 'F', 'A', 'T' };
+static const int SUPERBLOCK_VERSION = 2;
+static const int SUPERBLOCK_HEADER_SIZE = 36;
+
+static void putInt32(vector<char>& bytes, size_t offset, int value)
+{
+    Converter::encodeInt32LE(span<const int>(&value, 1), span<char>(bytes).subspan(offset, 4));
+}
+
+static int getInt32(const char* bytes, size_t offset)
+{
+    int value = 0;
+    Converter::decodeInt32LE(span<const char>(bytes + offset, 4), span<int>(&value, 1));
+    return value;
+}
+
+// Sizes the FAT and its bookkeeping for the geometry the disk was opened with
+void Mini_FAT::sizeForGeometry(int journalClusters)
+{
+    int clusterCount = Virtual_Disk::getClusterCount();
+    entriesPerFATCluster = Virtual_Disk::getClusterSize() / static_cast<int>(sizeof(int));
+    fatClusterCount = (clusterCount + entriesPerFATCluster - 1) / entriesPerFATCluster;
+    journalClusterCount = journalClusters;
+    FAT.assign(clusterCount, 0);
+    freeBitmap.assign((clusterCount + 63) / 64, 0);
+    fatClusterDirty.assign(fatClusterCount, false);
+    nextFitCursor = getFirstDataCluster();
+}
+
+// Initializes the FAT array; the superblock, the FAT's own clusters and the journal are used, the rest are free (0)
 void Mini_FAT::initialize_FAT() {
-    for (int i = 0; i < 1024; i++)
+    int journalEnd = fatClusterCount + journalClusterCount;
+    for (int i = 0; i < static_cast<int>(FAT.size()); i++)
     {
-        if (i == 0 || i == 4)
+        if (i == 0 || i == fatClusterCount || i == journalEnd)
         {
             FAT[i] = -1;
         }
-        else if (i > 0 && i <= 3)
+        else if (i > 0 && i < journalEnd)
         {
             FAT[i] = i + 1;
         }
@@ -23,6 +87,23 @@ void Mini_FAT::initialize_FAT() {
             FAT[i] = 0;
         }
     }
+    rebuildFreeBitmap();
+    markWholeFATDirty();
+}
+
+// Sets a bit for every free FAT entry and counts them
+void Mini_FAT::rebuildFreeBitmap()
+{
+    fill(freeBitmap.begin(), freeBitmap.end(), 0);
+    freeCount = 0;
+    for (int i = 0; i < static_cast<int>(FAT.size()); i++)
+    {
+        if (FAT[i] == 0)
+        {
+            freeBitmap[i / 64] |= uint64_t(1) << (i % 64);
+            freeCount++;
+        }
+    }
 }
 
 
@@ -31,127 +112,440 @@ void Mini_FAT::initialize_FAT() {
 void Mini_FAT::printFAT()
 {
     cout << "FAT has the following: ";
-    for (int i = 0; i < 1024; i++)
+    for (int i = 0; i < static_cast<int>(FAT.size()); i++)
         cout << "FAT[" << i << "] = " << Mini_FAT::FAT[i] << endl;
 }
 
-// Creates a superblock (vector) by copying the FAT array into bytes
+// Creates the superblock cluster recording the geometry of the open disk
 vector<char> Mini_FAT::createSuperBlock()
 {
-    vector<char> superBlock(1024, 0);  // Create vector with space for 1024 FAT entries
+    vector<char> superBlock(Virtual_Disk::getClusterSize(), 0);
+    memcpy(superBlock.data(), SUPERBLOCK_MAGIC, sizeof(SUPERBLOCK_MAGIC));
+    putInt32(superBlock, 4, SUPERBLOCK_VERSION);
+    putInt32(superBlock, 8, Virtual_Disk::getClusterSize());
+    putInt32(superBlock, 12, Virtual_Disk::getClusterCount());
+    putInt32(superBlock, 16, 1);
+    putInt32(superBlock, 20, fatClusterCount);
+    putInt32(superBlock, 24, journalClusterCount > 0 ? fatClusterCount + 1 : 0);
+    putInt32(superBlock, 28, journalClusterCount);
+    putInt32(superBlock, 32, rootCluster);
     return superBlock;
 }
 
 // Writes the FAT array to the virtual disk by splitting it into clusters
 void Mini_FAT::writeFAT()
 {
-    vector<char> FATBYTES = Converter::intArrayToByteArray(Mini_FAT::FAT, 1024);
-    vector<vector<char>> ls = Converter::splitBytes(FATBYTES);
-    for (int i = 0; i < ls.size(); i++)
+    // Only the clusters holding changed entries are serialized and written; the buffers are kept between calls,
+    // since every command ends with one
+    static vector<int> clusters;
+    static vector<char> FATBYTES;
+    clusters.clear();
+    for (int i = 0; i < fatClusterCount; i++)
+    {
+        if (fatClusterDirty[i])
+            clusters.push_back(1 + i);
+    }
+    if (clusters.empty())
+        return;
+
+    // Each dirty cluster's entries are encoded straight into its place in one buffer; the last FAT cluster may be
+    // only partly used, and the rest of it stays zero
+    size_t clusterSize = static_cast<size_t>(Virtual_Disk::getClusterSize());
+    FATBYTES.assign(clusters.size() * clusterSize, 0);
+    for (size_t c = 0; c < clusters.size(); c++)
     {
-        Virtual_Disk::writeCluster(ls[i], i + 1);
+        int i = clusters[c] - 1;
+        int first = i * entriesPerFATCluster;
+        int count = min(entriesPerFATCluster, static_cast<int>(FAT.size()) - first);
+        Converter::encodeInt32LE(span<const int>(FAT.data() + first, count), span<char>(FATBYTES).subspan(c * clusterSize));
+        fatClusterDirty[i] = false;
     }
+    Virtual_Disk::writeChain(clusters, FATBYTES);
+}
+
+// Forces the next writeFAT() to write the whole table
+void Mini_FAT::markWholeFATDirty()
+{
+    fill(fatClusterDirty.begin(), fatClusterDirty.end(), true);
 }
-// Reads the FAT array from the virtual disk (clusters 1-4) and reconstructs it
+// Reads the FAT array from the virtual disk (clusters 1..fatClusterCount) and reconstructs it
 void Mini_FAT::readFAT()
 {
-    vector<char> ls;
-    for (int i = 1; i <= 4; i++)
-    {
-        vector<char> b = Virtual_Disk::readCluster(i);
-        ls.insert(ls.end(), b.begin(), b.end());
-    }
-    Converter::byteArrayToIntArray(Mini_FAT::FAT, ls);
+    // The FAT is not loaded yet, so its clusters are listed explicitly rather than followed as a chain
+    vector<int> clusters(fatClusterCount);
+    for (int i = 0; i < fatClusterCount; i++)
+        clusters[i] = 1 + i;
+    vector<char> ls(static_cast<size_t>(fatClusterCount) * Virtual_Disk::getClusterSize());
+    Virtual_Disk::readClusters(clusters, ls);
+    // Decoded in one pass straight from the cluster buffer; padding after the last entry is not part of the FAT
+    Converter::decodeInt32LE(ls, FAT);
+    rebuildFreeBitmap();
+    // What was just read matches the disk
+    fill(fatClusterDirty.begin(), fatClusterDirty.end(), false);
 }
 
 // Sets the FAT array with a provided array of integers
-void Mini_FAT::setFAT(const int fat_array[1024]) {
-    memcpy(FAT, fat_array, 1024 * sizeof(int));  // Copy input FAT array to the FAT array
+void Mini_FAT::setFAT(span<const int> fat_array) {
+    copy_n(fat_array.begin(), min(fat_array.size(), FAT.size()), FAT.begin());  // Copy input FAT array to the FAT array
+    rebuildFreeBitmap();
+    markWholeFATDirty();
 }
 
 // Initializes or opens the file system. If the disk file doesn't exist, it creates it
-void Mini_FAT::initialize_Or_Open_FileSystem( string name) {
-    Virtual_Disk::createOrOpenDisk(name);
-    if (Virtual_Disk::isNew())
+void Mini_FAT::initialize_Or_Open_FileSystem(const string& name, DiskMode mode, int clusterSize, int clusterCount) {
+    // An existing image keeps the geometry recorded in its superblock; one without a recorded geometry is a default-sized image
+    char header[SUPERBLOCK_HEADER_SIZE];
+    size_t headerSize = Virtual_Disk::readHeader(name, header);
+    int journalClusters = 0;
+    if (headerSize > 0)
+    {
+        clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+        clusterCount = Virtual_Disk::DEFAULT_CLUSTER_COUNT;
+        if (headerSize == sizeof(header) && memcmp(header, SUPERBLOCK_MAGIC, sizeof(SUPERBLOCK_MAGIC)) == 0)
+        {
+            int storedSize = getInt32(header, 8);
+            int storedCount = getInt32(header, 12);
+            if (Virtual_Disk::isValidGeometry(storedSize, storedCount))
+            {
+                clusterSize = storedSize;
+                clusterCount = storedCount;
+                if (getInt32(header, 4) >= 2)
+                    journalClusters = clamp(getInt32(header, 28), 0, storedCount / 2);
+            }
+            else
+                cout << "Warning: The superblock holds an invalid geometry; using the default geometry.\n";
+        }
+    }
+    else if (!Virtual_Disk::isValidGeometry(clusterSize, clusterCount))
+    {
+        cout << "Warning: Unsupported geometry (" << clusterSize << "-byte clusters, " << clusterCount
+            << " clusters); using the default geometry.\n";
+        clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+        clusterCount = Virtual_Disk::DEFAULT_CLUSTER_COUNT;
+    }
+
+    Virtual_Disk::createOrOpenDisk(name, mode, clusterSize, clusterCount);
+    bool isNew = Virtual_Disk::isNew();
+    if (isNew)
+        journalClusters = Journal::clustersFor(Virtual_Disk::getClusterCount());
+    Mini_FAT::sizeForGeometry(journalClusters);
+    if (journalClusters > 0 && getFirstDataCluster() >= Virtual_Disk::getClusterCount())
+    {
+        // The superblock, the FAT and the journal must leave room for at least the root directory
+        cout << "Warning: The journal does not fit on this volume; running without it.\n";
+        Mini_FAT::sizeForGeometry(0);
+    }
+    Journal::open(fatClusterCount + 1, journalClusterCount);
+    if (isNew)
     {
         vector<char> superBlock = Mini_FAT::createSuperBlock();
         Virtual_Disk::writeCluster(superBlock, 0);
         Mini_FAT::initialize_FAT();
         Mini_FAT::writeFAT();
+        // Later writes rely on the journal, which needs the superblock on disk to be found again
+        Virtual_Disk::sync();
     }
     else
     {
+        // What a crash left in the journal is newer than the FAT and directories on disk
+        int records = Journal::replay();
+        if (records > 0)
+            cout << "Recovered " << records << " journaled change(s) that had not been checkpointed.\n";
         Mini_FAT::readFAT();
+        Mini_FAT::readRootCluster();
     }
 }
 
-// Returns the number of free clusters in the FAT array
-int Mini_FAT::getAvailableCluster()
-{
-    for (int i = 0; i < 1024; i++)
-    {
-        if (Mini_FAT::FAT[i] == 0)
-            return i;
-    }
-    return -1;//our disk is full
-}
-
-//Returns the index of the first free cluster in the FAT array
+//Returns the number of free clusters in the FAT array
 int Mini_FAT::getAvailableClusters()
 {
-    int counter = 0;
-    for (int i = 0; i < 1024; i++)
-    {
-        if (Mini_FAT::FAT[i] == 0)
-            counter++;
-    }
-    return counter;
+    return freeCount;
 }
 
 
 // Sets the pointer (next cluster) for a given cluster index in the FAT
 void Mini_FAT::setClusterPointer(int clusterIndex, int status)
 {
-    if (clusterIndex >= 0 && clusterIndex < 1024 && status >= 0 && status < 1024)
+    int clusterCount = static_cast<int>(Mini_FAT::FAT.size());
+    if (clusterIndex >= 0 && clusterIndex < clusterCount && status >= -1 && status < clusterCount)
+    {
+        // Keep the free-cluster bitmap in step when the entry turns free or used
+        if (Mini_FAT::FAT[clusterIndex] == status)
+            return;
+        bool wasFree = (Mini_FAT::FAT[clusterIndex] == 0);
+        bool isFree = (status == 0);
         Mini_FAT::FAT[clusterIndex] = status;
+        fatClusterDirty[clusterIndex / entriesPerFATCluster] = true;
+        if (wasFree != isFree)
+        {
+            uint64_t bit = uint64_t(1) << (clusterIndex % 64);
+            if (isFree)
+            {
+                freeBitmap[clusterIndex / 64] |= bit;
+                freeCount++;
+            }
+            else
+            {
+                freeBitmap[clusterIndex / 64] &= ~bit;
+                freeCount--;
+            }
+        }
+    }
 }
 
 // Retrieves the pointer (next cluster) for a given cluster index in the FAT
 int Mini_FAT::getClusterPointer(int clusterIndex)
 {
-    if (clusterIndex >= 0 && clusterIndex < 1024)
+    if (clusterIndex >= 0 && clusterIndex < static_cast<int>(Mini_FAT::FAT.size()))
         return Mini_FAT::FAT[clusterIndex];
     else
         return -1;
 }
 
+// Scans the bitmap a word at a time for the next set bit at or after from
+int Mini_FAT::nextFreeCluster(int from)
+{
+    int clusterCount = static_cast<int>(FAT.size());
+    if (from >= clusterCount)
+        return clusterCount;
+    int w = from / 64;
+    uint64_t word = freeBitmap[w] & (~uint64_t(0) << (from % 64));
+    while (word == 0)
+    {
+        if (++w == static_cast<int>(freeBitmap.size()))
+            return clusterCount;
+        word = freeBitmap[w];
+    }
+    return w * 64 + countr_zero(word);
+}
+
+// Same as nextFreeCluster on the inverted bitmap; bits past the last cluster count as used
+int Mini_FAT::nextUsedCluster(int from)
+{
+    int clusterCount = static_cast<int>(FAT.size());
+    if (from >= clusterCount)
+        return clusterCount;
+    int w = from / 64;
+    uint64_t word = ~freeBitmap[w] & (~uint64_t(0) << (from % 64));
+    while (word == 0)
+    {
+        if (++w == static_cast<int>(freeBitmap.size()))
+            return clusterCount;
+        word = ~freeBitmap[w];
+    }
+    return min(clusterCount, w * 64 + countr_zero(word));
+}
+
+// Hops from free run to free run until one is long enough
+int Mini_FAT::findFreeRun(int from, int to, int count)
+{
+    int start = nextFreeCluster(from);
+    while (start < to)
+    {
+        int end = nextUsedCluster(start);
+        if (end - start >= count && start + count <= to)
+            return start;
+        if (end >= to)
+            break;
+        start = nextFreeCluster(end);
+    }
+    return -1;
+}
+
+// Reserves a contiguous run when possible (near the hint, else next-fit), and links it into a chain
+vector<int> Mini_FAT::allocateChain(int count, int nearCluster)
+{
+    vector<int> chain;
+    int clusterCount = static_cast<int>(FAT.size());
+    int dataStart = getFirstDataCluster();
+    count = min(count, freeCount);
+    if (count <= 0)
+        return chain;
+
+    int from = (nearCluster >= dataStart && nearCluster < clusterCount) ? nearCluster : nextFitCursor;
+    if (from < dataStart || from >= clusterCount)
+        from = dataStart;
+
+    // One run of the full length, searching forward from the start point and then wrapping around
+    int start = findFreeRun(from, clusterCount, count);
+    if (start == -1)
+        start = findFreeRun(dataStart, min(clusterCount, from + count - 1), count);
+
+    chain.reserve(count);
+    if (start != -1)
+    {
+        for (int i = 0; i < count; i++)
+            chain.push_back(start + i);
+    }
+    else
+    {
+        // The free space is too fragmented: take the free runs in order from the start point
+        int cluster = nextFreeCluster(from);
+        if (cluster >= clusterCount)
+            cluster = nextFreeCluster(dataStart);
+        while (static_cast<int>(chain.size()) < count)
+        {
+            chain.push_back(cluster);
+            cluster = nextFreeCluster(cluster + 1);
+            if (cluster >= clusterCount)
+                cluster = nextFreeCluster(dataStart);
+        }
+    }
+
+    for (size_t i = 0; i < chain.size(); i++)
+        Mini_FAT::setClusterPointer(chain[i], i + 1 < chain.size() ? chain[i + 1] : -1);
+    nextFitCursor = chain.back() + 1;
+    return chain;
+}
+
+// Walks the existing chain and only touches its tail: the kept prefix is neither freed nor relinked
+vector<int> Mini_FAT::resizeChain(int firstCluster, int count, int nearCluster)
+{
+    vector<int> chain;
+    int clusterCount = static_cast<int>(FAT.size());
+
+    // A chain that was never allocated, or whose first cluster is free, starts from scratch
+    if (firstCluster <= 0 || firstCluster >= clusterCount || FAT[firstCluster] == 0)
+        return count > 0 ? allocateChain(count, nearCluster) : chain;
+
+    int cluster = firstCluster;
+    while (cluster > 0 && cluster < clusterCount && static_cast<int>(chain.size()) < count)
+    {
+        chain.push_back(cluster);
+        cluster = FAT[cluster];
+    }
+
+    if (static_cast<int>(chain.size()) == count)
+    {
+        // Shrinking (or the same length): end the chain here and free what followed
+        if (!chain.empty())
+            Mini_FAT::setClusterPointer(chain.back(), -1);
+        freeChain(cluster);
+    }
+    else
+    {
+        // Growing: the new tail goes right after the current last cluster when that space is free
+        vector<int> tail = allocateChain(count - static_cast<int>(chain.size()), chain.back() + 1);
+        if (!tail.empty())
+            Mini_FAT::setClusterPointer(chain.back(), tail[0]);
+        chain.insert(chain.end(), tail.begin(), tail.end());
+    }
+    return chain;
+}
+
+// Frees a chain link by link; the step cap guards against cycles
+void Mini_FAT::freeChain(int firstCluster)
+{
+    int clusterCount = static_cast<int>(FAT.size());
+    int cluster = firstCluster;
+    for (int steps = 0; cluster > 0 && cluster < clusterCount && steps < clusterCount; steps++)
+    {
+        int next = FAT[cluster];
+        Mini_FAT::setClusterPointer(cluster, 0);
+        cluster = next;
+    }
+}
+
+// Counts the clusters of a chain by following the FAT from its first cluster
+int Mini_FAT::getChainLength(int firstCluster)
+{
+    int length = 0;
+    int cluster = firstCluster;
+    // Cluster 0 holds the superblock, so it never belongs to a chain; the length cap guards against cycles
+    int clusterCount = static_cast<int>(Mini_FAT::FAT.size());
+    while (cluster > 0 && cluster < clusterCount && length < clusterCount)
+    {
+        length++;
+        cluster = Mini_FAT::FAT[cluster];
+    }
+    return length;
+}
+
 // Returns the total free space available on the disk (in bytes)
-int Mini_FAT::getFreeSize()
+long long Mini_FAT::getFreeSize()
+{
+    return static_cast<long long>(Mini_FAT::getAvailableClusters()) * Virtual_Disk::getClusterSize();
+}
+
+bool Mini_FAT::beginTransaction()
+{
+    // Start from a clean FAT so that an abort only has to re-read it; with a journal, what was committed is already durable
+    writeFAT();
+    if (!Journal::isEnabled())
+        Virtual_Disk::sync();
+    return Virtual_Disk::beginTransaction();
+}
+
+bool Mini_FAT::commitTransaction()
+{
+    if (!Virtual_Disk::isTransactionOpen())
+        return false;
+    writeFAT();
+    if (!Journal::isEnabled())
+        return Virtual_Disk::commitTransaction(getFirstDataCluster());
+    Journal::commit(Virtual_Disk::takeStaged());
+    Virtual_Disk::releaseStaged();
+    return true;
+}
+
+bool Mini_FAT::abortTransaction()
 {
-    return Mini_FAT::getAvailableClusters() * 1024;
+    if (!Virtual_Disk::abortTransaction())
+        return false;
+    readFAT();
+    readRootCluster();
+    return true;
+}
+
+int Mini_FAT::getRootCluster()
+{
+    return rootCluster;
+}
+
+// Rewrites the superblock, which also upgrades an older one to the current version (its journal count stays 0)
+void Mini_FAT::setRootCluster(int firstCluster)
+{
+    if (firstCluster == rootCluster)
+        return;
+    rootCluster = firstCluster;
+    Virtual_Disk::writeCluster(createSuperBlock(), 0);
+}
+
+// Reads the root's first cluster from the superblock on disk, after the journal has been replayed into it
+void Mini_FAT::readRootCluster()
+{
+    vector<char> superBlock(Virtual_Disk::getClusterSize());
+    Virtual_Disk::readCluster(0, superBlock);
+    rootCluster = 0;
+    if (memcmp(superBlock.data(), SUPERBLOCK_MAGIC, sizeof(SUPERBLOCK_MAGIC)) == 0 && getInt32(superBlock.data(), 4) >= 2)
+    {
+        int stored = getInt32(superBlock.data(), 32);
+        if (stored >= getFirstDataCluster() && stored < static_cast<int>(FAT.size()) && FAT[stored] != 0)
+            rootCluster = stored;
+    }
 }
 
 void Mini_FAT::CloseTheSystem()
 {
+    abortTransaction();
     Mini_FAT::writeFAT();
+    Journal::close();
     Virtual_Disk::closeDisk();
 }
 
 
 long long Mini_FAT::getTotalClusters() {
-    return  1024;
+    return  Virtual_Disk::getClusterCount();
 }
 
 long long Mini_FAT::getFreeClusters() {
-    long long count = 0;
-    for (long long i = 0; i < getTotalClusters(); ++i) {
-        if (FAT[i] == 0) { // Assuming 0 indicates a free cluster
-            count++;
-        }
-    }
-    return count;
+    return freeCount;
 }
 
 long long Mini_FAT::getClusterSize() {
-    return 1024; // Example cluster size: 4KB
+    return Virtual_Disk::getClusterSize();
+}
+
+int Mini_FAT::getFirstDataCluster() {
+    return fatClusterCount + journalClusterCount + 1;
 }
\ No newline at end of file
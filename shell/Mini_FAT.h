@@ -1,21 +1,24 @@
 #pragma once
 #include "Virtual_Disk.h"
+#include <cstdint>
+#include <span>
 #include <vector>
 #include <string>
 using namespace std;
 class Mini_FAT
 {
 public:
-    /** FAT array representing cluster states: -1 for EOF, 0 for free, and positive values for next cluster in chain. */
-    static int FAT[1024];
+    /** FAT array representing cluster states: -1 for EOF, 0 for free, and positive values for next cluster in chain.
+        It has one entry per cluster of the volume. */
+    static vector<int> FAT;
 
-    /** Initializes the FAT, marking reserved clusters as -1 and others as free (0). */
+    /** Initializes the FAT for the open disk's geometry, marking the superblock, FAT and journal clusters as used and others as free (0). */
     static void initialize_FAT();
 
-    /** Creates the superblock as a byte vector by serializing the FAT. */
+    /** Creates the superblock cluster, recording the volume geometry (see the layout in Mini_FAT.cpp). */
     static vector<char> createSuperBlock();
 
-    /** Writes the FAT to the virtual disk by splitting into clusters. */
+    /** Commit point for the FAT: writes only the FAT clusters changed since the last call (a no-op if none did). */
     static void writeFAT();
 
     /** Reads the FAT from the virtual disk and reconstructs it. */
@@ -24,27 +27,63 @@ public:
     /** Prints the FAT contents for debugging purposes. */
     static void printFAT();
 
-    /** Sets the FAT array with the provided data. */
-    static void setFAT(const int fat_arr[1024]);
+    /** Sets the FAT array with the provided data (one entry per cluster). */
+    static void setFAT(span<const int> fat_arr);
 
-    /** Initializes or opens the file system, creating or reading from the virtual disk. */
-    static void initialize_Or_Open_FileSystem( string name);
+    /** Initializes or opens the file system in the given mode. A new disk is created with the given geometry and a journal;
+        an existing one keeps the geometry recorded in its superblock, and its journal is replayed before the FAT is read. */
+    static void initialize_Or_Open_FileSystem(const string& name, DiskMode mode = DiskMode::Stream,
+        int clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE, int clusterCount = Virtual_Disk::DEFAULT_CLUSTER_COUNT);
 
-    /** Returns the number of free clusters in the FAT. */
+    /** Returns the number of free clusters in the FAT (maintained incrementally, no scan). */
     static int getAvailableClusters();
 
-    /** Returns the index of the first available (free) cluster. */
-    static int getAvailableCluster();
-
     /** Sets the pointer for a cluster in the FAT (next cluster, EOF, or free). */
     static void setClusterPointer(int clusterIndex, int pointer);
 
     /** Gets the pointer value for a specific cluster in the FAT. */
     static int getClusterPointer(int clusterIndex);
 
+    /** Allocates up to count free clusters and links them into a chain ending in EOF; returns fewer if the disk fills up.
+        The chain is taken as one contiguous run when there is one, searching from nearCluster (e.g. the parent directory's
+        first cluster) or, without a hint, from where the previous allocation ended; otherwise it is assembled from the
+        free runs that follow. */
+    static vector<int> allocateChain(int count, int nearCluster = -1);
+
+    /** Makes the chain starting at firstCluster count clusters long, keeping its existing clusters in place and only
+        allocating (near nearCluster) or freeing the difference at the tail; returns the clusters of the resulting chain.
+        A firstCluster of 0 starts a new chain. */
+    static vector<int> resizeChain(int firstCluster, int count, int nearCluster = -1);
+
+    /** Frees every cluster of the chain starting at firstCluster. */
+    static void freeChain(int firstCluster);
+
+    /** Returns the number of clusters in the chain starting at firstCluster. */
+    static int getChainLength(int firstCluster);
+
     /** Returns the total free space on the disk in bytes. */
-    static int getFreeSize();
+    static long long getFreeSize();
+
+    /** Starts a transaction: until it commits, FAT and cluster writes (and directory flushes, which go through them)
+        stay in memory, and a crash or abort leaves the image as it was. Returns false if one is already open. */
+    static bool beginTransaction();
 
+    /** Commits the transaction: writes the changed FAT clusters, then logs every staged cluster as one journal record
+        (or, on an image without a journal, writes them in one ordered flush: data and directories before the FAT).
+        Directories must have been flushed first (Directory::flushAll()). Returns false if no transaction is open. */
+    static bool commitTransaction();
+
+    /** Discards everything written since beginTransaction() and reloads the FAT from the disk. Directory objects
+        loaded during the transaction no longer match the disk and must be re-read. Returns false if none is open. */
+    static bool abortTransaction();
+
+    /** First cluster of the root directory as recorded in the superblock, 0 if the root has none. */
+    static int getRootCluster();
+
+    /** Records a new first cluster for the root directory, rewriting the superblock if it changed. */
+    static void setRootCluster(int firstCluster);
+
+    /** Checkpoints the journal and closes the disk; an open transaction is aborted. */
     static void CloseTheSystem();
 
     static long long getTotalClusters();
@@ -53,6 +92,48 @@ public:
 
     static long long getClusterSize();
 
+    /** Returns the first cluster after the superblock, the FAT and the journal, where directories and files start. */
+    static int getFirstDataCluster();
 
 private:
+    /** One bit per cluster, set while the cluster is free; kept in sync with FAT by setClusterPointer. */
+    static vector<uint64_t> freeBitmap;
+
+    /** Number of set bits in freeBitmap. */
+    static int freeCount;
+
+    /** Next-fit cursor: the cluster after the end of the last allocated chain, where hint-less searches start. */
+    static int nextFitCursor;
+
+    /** Return the first free (or used) cluster at or after from, or the cluster count if there is none. */
+    static int nextFreeCluster(int from);
+    static int nextUsedCluster(int from);
+
+    /** Returns the start of the first run of count free clusters in [from, to), or -1 if there is none. */
+    static int findFreeRun(int from, int to, int count);
+
+    /** Rebuilds the bitmap and the free count from the FAT after it is replaced wholesale. */
+    static void rebuildFreeBitmap();
+
+    /** Number of disk clusters holding the FAT (starting at cluster 1), and how many FAT entries each of them stores. */
+    static int fatClusterCount;
+    static int entriesPerFATCluster;
+
+    /** Number of journal clusters, right after the FAT (0 on images created before the journal). */
+    static int journalClusterCount;
+
+    /** First cluster of the root directory, kept in step with the superblock. */
+    static int rootCluster;
+
+    /** Reads rootCluster from the superblock on disk. */
+    static void readRootCluster();
+
+    /** Which FAT clusters hold entries changed since the last writeFAT(). */
+    static vector<bool> fatClusterDirty;
+
+    /** Sizes the FAT, the bitmap and the dirty flags for the open disk's geometry and journal size. */
+    static void sizeForGeometry(int journalClusters);
+
+    /** Marks every FAT cluster dirty, after the FAT is replaced wholesale. */
+    static void markWholeFATDirty();
 };
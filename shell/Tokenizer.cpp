@@ -10,7 +10,7 @@ vector<string> Tokenizer::tokenize(const string& input)
     bool inQuotes = false;
     string currentToken;
 
-    while (stream >> ws) { // Skip any leading whitespace
+    while (stream >> ws && !stream.eof()) { // Skip any leading whitespace; a quoted last token leaves only eof set
         char c = stream.peek();
         if (c == '\"') {
             // Handle quoted string
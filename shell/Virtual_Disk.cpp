@@ -1,73 +1,825 @@
 #include "Virtual_Disk.h"
+#include "Async_IO.h"
+#include "Mini_FAT.h"
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
 // Initialize the static file stream object for the virtual disk
 fstream Virtual_Disk::Disk;
 
+// Initialize the memory-mapped backend (unused in Stream mode)
+DiskMode Virtual_Disk::mode = DiskMode::Stream;
+int Virtual_Disk::clusterSize = Virtual_Disk::DEFAULT_CLUSTER_SIZE;
+int Virtual_Disk::clusterCount = Virtual_Disk::DEFAULT_CLUSTER_COUNT;
+char* Virtual_Disk::mappedImage = nullptr;
+bool Virtual_Disk::mappedDirty = false;
+bool Virtual_Disk::mappedWasNew = false;
+#ifdef _WIN32
+void* Virtual_Disk::fileHandle = nullptr;
+void* Virtual_Disk::mappingHandle = nullptr;
+#else
+int Virtual_Disk::fileDescriptor = -1;
+#endif
+
+// Initialize the write-back cache and its counters
+unordered_map<int, Virtual_Disk::CachedCluster> Virtual_Disk::cache;
+list<int> Virtual_Disk::lru;
+size_t Virtual_Disk::fileDataClusters = 0;
+long long Virtual_Disk::hits = 0;
+long long Virtual_Disk::misses = 0;
+long long Virtual_Disk::writebacks = 0;
+long long Virtual_Disk::clusterWrites = 0;
+
+// Runs queued on the ring in Async mode, and the zeros that pad a partly covered last cluster
+vector<Virtual_Disk::PendingRun> Virtual_Disk::pendingRuns;
+static const char ZEROS[Virtual_Disk::MAX_CLUSTER_SIZE] = {};
+vector<char> Virtual_Disk::compareBuffer;
+bool Virtual_Disk::transactionOpen = false;
+map<int, vector<char>> Virtual_Disk::staged;
+map<int, vector<char>> Virtual_Disk::stagedFileData;
+map<int, vector<char>> Virtual_Disk::taken;
+vector<map<int, vector<char>>::node_type> Virtual_Disk::spareStaged;
+
 // Functions
-void Virtual_Disk::createOrOpenDisk(const string& path) {
+bool Virtual_Disk::isValidGeometry(int size, int count)
+{
+    bool powerOfTwo = size > 0 && (size & (size - 1)) == 0;
+    return powerOfTwo && size >= MIN_CLUSTER_SIZE && size <= MAX_CLUSTER_SIZE
+        && count >= MIN_CLUSTER_COUNT && count <= MAX_CLUSTER_COUNT;
+}
+
+void Virtual_Disk::createOrOpenDisk(const string& path, DiskMode requestedMode, int size, int count) {
+    clusterSize = size;
+    clusterCount = count;
+
+    // In Mapped mode the whole image lives in memory and the stream is not used
+    if (requestedMode == DiskMode::Mapped && mapDisk(path)) {
+        mode = DiskMode::Mapped;
+        return;
+    }
+
+    mode = DiskMode::Stream;
     Disk.open(path, ios::in | ios::out | ios::binary);
 
     if (!Disk.is_open()) {
         Disk.open(path, ios::in | ios::out | ios::binary | ios::trunc);
 
-        
+
+    }
+
+    // A second handle on the same file, which syncFile() uses to make writes durable; Async mode also drives it
+    // through io_uring, and without a ring the stream is used alone
+#ifdef _WIN32
+    if (Disk.is_open()) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        fileHandle = file != INVALID_HANDLE_VALUE ? file : nullptr;
+    }
+#else
+    if (Disk.is_open()) {
+        fileDescriptor = open(path.c_str(), O_RDWR);
+        if (requestedMode == DiskMode::Async && fileDescriptor >= 0 && Async_IO::open(fileDescriptor)) {
+            mode = DiskMode::Async;
+        }
+    }
+#endif
+}
+
+DiskMode Virtual_Disk::getMode()
+{
+    return mode;
+}
+
+size_t Virtual_Disk::readHeader(const string& path, span<char> out)
+{
+    ifstream file(path, ios::in | ios::binary);
+    if (!file.is_open())
+        return 0;
+    file.read(out.data(), static_cast<streamsize>(out.size()));
+    return static_cast<size_t>(file.gcount());
+}
+
+int Virtual_Disk::getClusterSize()
+{
+    return clusterSize;
+}
+
+int Virtual_Disk::getClusterCount()
+{
+    return clusterCount;
+}
+
+long long Virtual_Disk::getDiskSize()
+{
+    return static_cast<long long>(clusterSize) * clusterCount;
+}
+
+bool Virtual_Disk::mapDisk(const string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    mappedWasNew = (size.QuadPart == 0);
+
+    // Mapping the full image size grows a short (or new) image to its full size with zeros
+    long long diskSize = getDiskSize();
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(diskSize >> 32), static_cast<DWORD>(diskSize & 0xFFFFFFFF), nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(diskSize));
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedImage = static_cast<char*>(view);
+#else
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    mappedWasNew = (info.st_size == 0);
+
+    // A short (or new) image is grown to its full size with zeros before mapping it
+    long long diskSize = getDiskSize();
+    if (info.st_size < diskSize && ftruncate(fd, diskSize) != 0) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(diskSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    fileDescriptor = fd;
+    mappedImage = static_cast<char*>(view);
+#endif
+    mappedDirty = false;
+    return true;
+}
+
+void Virtual_Disk::unmapDisk()
+{
+    if (mappedImage == nullptr)
+        return;
+
+    sync();
+#ifdef _WIN32
+    UnmapViewOfFile(mappedImage);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(mappedImage, static_cast<size_t>(getDiskSize()));
+    close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    mappedImage = nullptr;
+}
+
+void Virtual_Disk::writeCluster(span<const char> cluster, int clusterIndex, ClusterUse use)
+{
+    if (transactionOpen)
+    {
+        stage(clusterIndex, 1, cluster.data(), static_cast<size_t>(clusterSize), use);
+        return;
     }
+    clusterWrites++;
+
+    // In Mapped mode a write is a copy into the image; msync happens in sync()
+    if (mode == DiskMode::Mapped)
+    {
+        memcpy(mappedImage + static_cast<long long>(clusterIndex) * clusterSize, cluster.data(), clusterSize);
+        mappedDirty = true;
+        return;
+    }
+
+    // Update the cached copy if there is one, otherwise cache the new data;
+    // the data only reaches the file when the cluster is evicted or sync() is called
+    auto it = cache.find(clusterIndex);
+    CachedCluster& entry = (it != cache.end()) ? it->second : insert(clusterIndex, true, use);
+    memcpy(entry.data.data(), cluster.data(), clusterSize);
+    entry.dirty = true;
+    setUse(entry, use);
+    touch(entry);
 }
 
+void Virtual_Disk::readCluster(int clusterIndex, span<char> out, ClusterUse use)
+{
+    // Data staged by an open transaction is newer than anything in the cache or the image
+    for (const map<int, vector<char>>* clusters : { &staged, &stagedFileData })
+    {
+        auto stagedCluster = clusters->find(clusterIndex);
+        if (stagedCluster != clusters->end())
+        {
+            memcpy(out.data(), stagedCluster->second.data(), clusterSize);
+            return;
+        }
+    }
+
+    // In Mapped mode the cluster is read straight from the image
+    if (mode == DiskMode::Mapped)
+    {
+        memcpy(out.data(), mappedImage + static_cast<long long>(clusterIndex) * clusterSize, clusterSize);
+        return;
+    }
+
+    // Serve the cluster from memory when it is cached
+    auto it = cache.find(clusterIndex);
+    if (it != cache.end())
+    {
+        hits++;
+        setUse(it->second, use);
+        touch(it->second);
+        memcpy(out.data(), it->second.data.data(), clusterSize);
+        return;
+    }
+
+    // Otherwise read it from the file and keep a clean copy
+    misses++;
+    CachedCluster& entry = insert(clusterIndex, false, use);
+    readRunFromFile(clusterIndex, 1, entry.data.data());
+    memcpy(out.data(), entry.data.data(), clusterSize);
+}
 
+void Virtual_Disk::readClusters(span<const int> clusters, span<char> out)
+{
+    // Fill the caller's buffer run by run
+    beginBatch();
+    size_t i = 0;
+    while (i < clusters.size())
+    {
+        int length = runLength(clusters, i);
+        readRun(clusters[i], length, out.data() + i * clusterSize);
+        i += length;
+    }
+    finishBatch();
+}
 
+int Virtual_Disk::readChain(int firstCluster, span<char> out)
+{
+    beginBatch();
+    int count = queueChain(firstCluster, out);
+    finishBatch();
+    return count;
+}
 
-void Virtual_Disk::writeCluster(const vector<char>& cluster, int clusterIndex)
+int Virtual_Disk::queueChain(int firstCluster, span<char> out)
 {
-    // Move the write pointer to the position of the specified cluster index
-    Disk.seekp(clusterIndex * 1024, ios::beg);
-   
+    // Follow the FAT and issue each run of consecutive clusters as soon as it ends
+    int capacity = static_cast<int>(out.size() / clusterSize);
+    int count = 0;
+    int cluster = firstCluster;
+    // Cluster 0 holds the superblock, so it never belongs to a chain
+    while (cluster > 0 && cluster < clusterCount && count < capacity)
+    {
+        int runStart = cluster;
+        int length = 1;
+        int next = Mini_FAT::getClusterPointer(cluster);
+        while (next == runStart + length && count + length < capacity)
+        {
+            length++;
+            next = Mini_FAT::getClusterPointer(next);
+        }
 
+        readRun(runStart, length, out.data() + static_cast<size_t>(count) * clusterSize);
+        count += length;
+        cluster = next;
+    }
+    return count;
+}
 
-    // Write the 1024 bytes of data from the vector to the disk at the current position
-    Disk.write(cluster.data(), 1024);
+void Virtual_Disk::writeChain(span<const int> clusters, span<const char> buffer, ClusterUse use)
+{
+    beginBatch();
+    size_t i = 0;
+    while (i < clusters.size())
+    {
+        int length = runLength(clusters, i);
+        // The last run may only be partly covered by the buffer; writeRun pads it with zeros
+        size_t offset = min(i * static_cast<size_t>(clusterSize), buffer.size());
+        size_t size = min(static_cast<size_t>(length) * clusterSize, buffer.size() - offset);
+        writeRun(clusters[i], length, buffer.data() + offset, size, use);
+        i += length;
+    }
+    finishBatch();
+}
 
-    // If the write operation fails, display an error
-   
+int Virtual_Disk::writeChangedClusters(span<const int> clusters, span<const char> buffer, ClusterUse use)
+{
+    // Read what the clusters hold now (a copy from memory when cached or mapped)
+    size_t size = static_cast<size_t>(clusterSize);
+    compareBuffer.resize(clusters.size() * size);
+    readClusters(clusters, compareBuffer);
 
-    // Flush the stream to ensure data is written to the disk
+    // A cluster is unchanged when it holds its slice of the buffer followed by zero padding
+    auto unchanged = [&](size_t k) {
+        size_t offset = min(k * size, buffer.size());
+        size_t covered = min(size, buffer.size() - offset);
+        const char* current = compareBuffer.data() + k * size;
+        return memcmp(current, buffer.data() + offset, covered) == 0
+            && memcmp(current + covered, ZEROS, size - covered) == 0;
+    };
+
+    beginBatch();
+    int written = 0;
+    size_t i = 0;
+    while (i < clusters.size())
+    {
+        if (unchanged(i))
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the write over the following clusters while they are consecutive on disk and also changed
+        size_t length = 1;
+        while (i + length < clusters.size() && clusters[i + length] == clusters[i] + static_cast<int>(length) && !unchanged(i + length))
+            length++;
+
+        size_t offset = min(i * size, buffer.size());
+        size_t runSize = min(length * size, buffer.size() - offset);
+        writeRun(clusters[i], static_cast<int>(length), buffer.data() + offset, runSize, use);
+        written += static_cast<int>(length);
+        i += length;
+    }
+    finishBatch();
+    return written;
+}
+
+int Virtual_Disk::runLength(span<const int> clusters, size_t start)
+{
+    int length = 1;
+    while (start + length < clusters.size() && clusters[start + length] == clusters[start] + length)
+        length++;
+    return length;
+}
+
+void Virtual_Disk::readRun(int firstCluster, int count, char* out)
+{
+    if (mode == DiskMode::Mapped)
+    {
+        memcpy(out, mappedImage + static_cast<long long>(firstCluster) * clusterSize, static_cast<size_t>(count) * clusterSize);
+        overlayDirty(firstCluster, count, out);
+        return;
+    }
+
+    // In Async mode the read is only queued; finishBatch() completes it
+    if (mode == DiskMode::Async)
+    {
+        Async_IO::queueRead(out, static_cast<size_t>(count) * clusterSize, static_cast<long long>(firstCluster) * clusterSize);
+        pendingRuns.push_back({ firstCluster, count, out, nullptr, 0 });
+        return;
+    }
+
+    readRunFromFile(firstCluster, count, out);
+    overlayDirty(firstCluster, count, out);
+}
+
+void Virtual_Disk::writeRun(int firstCluster, int count, const char* data, size_t size, ClusterUse use)
+{
+    if (transactionOpen)
+    {
+        stage(firstCluster, count, data, size, use);
+        return;
+    }
+    clusterWrites += count;
+    size_t runBytes = static_cast<size_t>(count) * clusterSize;
+
+    if (mode == DiskMode::Mapped)
+    {
+        char* target = mappedImage + static_cast<long long>(firstCluster) * clusterSize;
+        memcpy(target, data, size);
+        memset(target + size, 0, runBytes - size);
+        mappedDirty = true;
+        return;
+    }
+
+    if (mode == DiskMode::Async)
+    {
+        long long offset = static_cast<long long>(firstCluster) * clusterSize;
+        Async_IO::queueWrite(data, size, offset);
+        for (size_t padded = size; padded < runBytes; padded += min(runBytes - padded, sizeof(ZEROS)))
+            Async_IO::queueWrite(ZEROS, min(runBytes - padded, sizeof(ZEROS)), offset + static_cast<long long>(padded));
+        pendingRuns.push_back({ firstCluster, count, nullptr, data, size });
+    }
+    else
+        writePaddedRunToFile(firstCluster, count, data, size);
+
+    // The file now holds the newest data, so cached copies are refreshed and clean
+    for (int i = 0; i < count; i++)
+    {
+        auto it = cache.find(firstCluster + i);
+        if (it == cache.end())
+            continue;
+        size_t offset = static_cast<size_t>(i) * clusterSize;
+        size_t covered = (size > offset) ? min(size - offset, static_cast<size_t>(clusterSize)) : 0;
+        memcpy(it->second.data.data(), data + offset, covered);
+        memset(it->second.data.data() + covered, 0, clusterSize - covered);
+        it->second.dirty = false;
+    }
+}
+
+void Virtual_Disk::overlayDirty(int firstCluster, int count, char* out)
+{
+    // Clusters still dirty in the cache are newer than the file, and clusters staged by a transaction newer still
+    for (int i = 0; i < count; i++)
+    {
+        auto it = cache.find(firstCluster + i);
+        if (it != cache.end() && it->second.dirty)
+            memcpy(out + static_cast<size_t>(i) * clusterSize, it->second.data.data(), clusterSize);
+    }
+    for (const map<int, vector<char>>* clusters : { &staged, &stagedFileData })
+    {
+        for (auto it = clusters->lower_bound(firstCluster); it != clusters->end() && it->first < firstCluster + count; ++it)
+            memcpy(out + static_cast<size_t>(it->first - firstCluster) * clusterSize, it->second.data(), clusterSize);
+    }
+}
+
+void Virtual_Disk::stage(int firstCluster, int count, const char* data, size_t size, ClusterUse use)
+{
+    map<int, vector<char>>& target = use == ClusterUse::FileData ? stagedFileData : staged;
+    map<int, vector<char>>& other = use == ClusterUse::FileData ? staged : stagedFileData;
+    for (int i = 0; i < count; i++)
+    {
+        int index = firstCluster + i;
+        auto it = target.find(index);
+        if (it == target.end())
+        {
+            // A freed cluster reused for the other kind of data moves over, node and buffer included
+            auto moved = other.find(index);
+            if (moved != other.end())
+                it = target.insert(other.extract(moved)).position;
+            else if (!spareStaged.empty())
+            {
+                // A recycled node keeps its cluster buffer
+                auto node = std::move(spareStaged.back());
+                spareStaged.pop_back();
+                node.key() = index;
+                it = target.insert(std::move(node)).position;
+            }
+            else
+                it = target.emplace(index, vector<char>()).first;
+        }
+        vector<char>& copy = it->second;
+        copy.assign(clusterSize, 0);
+        size_t offset = static_cast<size_t>(i) * clusterSize;
+        if (offset < size)
+            memcpy(copy.data(), data + offset, min(size - offset, static_cast<size_t>(clusterSize)));
+    }
+}
+
+void Virtual_Disk::writeStaged(const map<int, vector<char>>& clusters, int from, int to, ClusterUse use)
+{
+    // Each run is copied into one buffer; the buffers stay alive until the batch completes and are reused by later
+    // commits, so a commit no larger than an earlier one does not allocate
+    static vector<vector<char>> runs;
+    size_t used = 0;
+    beginBatch();
+    auto it = clusters.lower_bound(from);
+    while (it != clusters.end() && it->first < to)
+    {
+        if (used == runs.size())
+            runs.emplace_back();
+        vector<char>& run = runs[used++];
+        run.clear();
+        int first = it->first;
+        int count = 0;
+        while (it != clusters.end() && it->first == first + count && it->first < to)
+        {
+            run.insert(run.end(), it->second.begin(), it->second.end());
+            count++;
+            ++it;
+        }
+        writeRun(first, count, run.data(), run.size(), use);
+    }
+    finishBatch();
+}
+
+bool Virtual_Disk::beginTransaction()
+{
+    if (transactionOpen)
+        return false;
+    transactionOpen = true;
+    return true;
+}
+
+bool Virtual_Disk::commitTransaction(int firstDataCluster)
+{
+    if (!transactionOpen)
+        return false;
+    transactionOpen = false;
+
+    // Data and directories first, made durable before the superblock and FAT that refer to them
+    writeStaged(stagedFileData, 0, clusterCount, ClusterUse::FileData);
+    writeStaged(staged, firstDataCluster, clusterCount, ClusterUse::Metadata);
+    sync();
+    writeStaged(staged, 0, firstDataCluster, ClusterUse::Metadata);
+    sync();
+    recycleStaged(stagedFileData);
+    recycleStaged(staged);
+    return true;
+}
+
+bool Virtual_Disk::abortTransaction()
+{
+    if (!transactionOpen)
+        return false;
+    transactionOpen = false;
+    recycleStaged(stagedFileData);
+    recycleStaged(staged);
+    return true;
+}
+
+const map<int, vector<char>>& Virtual_Disk::takeStaged()
+{
+    recycleStaged(taken);
+    if (transactionOpen)
+    {
+        transactionOpen = false;
+        // File data is written once, in place, and made durable before the journal record that refers to it is
+        // written, so a replayed record never points at data that did not reach the disk. Logging it as well would
+        // write every data cluster twice
+        if (!stagedFileData.empty())
+        {
+            writeStaged(stagedFileData, 0, clusterCount, ClusterUse::FileData);
+            sync();
+            recycleStaged(stagedFileData);
+        }
+        taken.swap(staged);
+    }
+    return taken;
+}
+
+void Virtual_Disk::releaseStaged()
+{
+    recycleStaged(taken);
+}
+
+void Virtual_Disk::recycleStaged(map<int, vector<char>>& clusters)
+{
+    while (!clusters.empty() && spareStaged.size() < SPARE_STAGED_CAPACITY)
+        spareStaged.push_back(clusters.extract(clusters.begin()));
+    clusters.clear();
+}
+
+bool Virtual_Disk::isTransactionOpen()
+{
+    return transactionOpen;
+}
+
+void Virtual_Disk::beginBatch()
+{
+    // Bytes still buffered in the stream must reach the file before the ring reads or overwrites it
+    if (mode == DiskMode::Async)
+        Disk.flush();
+}
+
+void Virtual_Disk::finishBatch()
+{
+    if (pendingRuns.empty())
+        return;
+
+    // Wait for the whole batch; if the ring reports a failure, redo the batch synchronously
+    bool completed = Async_IO::submitAndWait();
+    for (const PendingRun& run : pendingRuns)
+    {
+        if (run.out != nullptr)
+        {
+            if (!completed)
+                readRunFromFile(run.firstCluster, run.count, run.out);
+            overlayDirty(run.firstCluster, run.count, run.out);
+        }
+        else if (!completed)
+            writePaddedRunToFile(run.firstCluster, run.count, run.data, run.size);
+    }
+    pendingRuns.clear();
+}
+
+void Virtual_Disk::readRunFromFile(int firstCluster, int count, char* out)
+{
+    Disk.seekg(static_cast<long long>(firstCluster) * clusterSize, ios::beg);
+    Disk.read(out, static_cast<streamsize>(count) * clusterSize);
+
+    // A cluster that was never written lies past the end of the file; it reads as zeros
+    // and the stream must be usable again for the next operation
+    streamsize got = Disk.gcount();
+    if (got < static_cast<streamsize>(count) * clusterSize)
+    {
+        fill(out + got, out + static_cast<streamsize>(count) * clusterSize, 0);
+        Disk.clear();
+    }
+}
+
+void Virtual_Disk::writeRunToFile(int firstCluster, int count, const char* data)
+{
+    Disk.seekp(static_cast<long long>(firstCluster) * clusterSize, ios::beg);
+    Disk.write(data, static_cast<streamsize>(count) * clusterSize);
+}
+
+void Virtual_Disk::writePaddedRunToFile(int firstCluster, int count, const char* data, size_t size)
+{
+    // One seek for the run; the zero padding follows the data in the same stream write sequence
+    size_t runBytes = static_cast<size_t>(count) * clusterSize;
+    Disk.seekp(static_cast<long long>(firstCluster) * clusterSize, ios::beg);
+    Disk.write(data, static_cast<streamsize>(size));
+    for (size_t padded = size; padded < runBytes; padded += min(runBytes - padded, sizeof(ZEROS)))
+        Disk.write(ZEROS, static_cast<streamsize>(min(runBytes - padded, sizeof(ZEROS))));
+}
+
+void Virtual_Disk::sync()
+{
+    // Nothing leaves the staging area before the transaction commits
+    if (transactionOpen)
+        return;
+
+    // In Mapped mode there is no cache: push the modified pages to the file
+    if (mode == DiskMode::Mapped)
+    {
+        if (mappedDirty)
+        {
+#ifdef _WIN32
+            FlushViewOfFile(mappedImage, static_cast<SIZE_T>(getDiskSize()));
+            FlushFileBuffers(static_cast<HANDLE>(fileHandle));
+#else
+            msync(mappedImage, static_cast<size_t>(getDiskSize()), MS_SYNC);
+#endif
+            mappedDirty = false;
+        }
+        return;
+    }
+
+    // Write dirty clusters in ascending order so the file is updated sequentially
+    static vector<int> dirtyClusters;
+    dirtyClusters.clear();
+    for (const auto& [clusterIndex, entry] : cache)
+    {
+        if (entry.dirty)
+            dirtyClusters.push_back(clusterIndex);
+    }
+    sort(dirtyClusters.begin(), dirtyClusters.end());
+
+    for (int clusterIndex : dirtyClusters)
+    {
+        CachedCluster& entry = cache[clusterIndex];
+        writeRunToFile(clusterIndex, 1, entry.data.data());
+        entry.dirty = false;
+        writebacks++;
+    }
+
+    // Flush and sync the file once for the whole batch
+    syncFile();
+}
+
+void Virtual_Disk::syncClusters(int firstCluster, int count)
+{
+    if (transactionOpen)
+        return;
+
+    if (mode == DiskMode::Mapped)
+    {
+        char* start = mappedImage + static_cast<long long>(firstCluster) * clusterSize;
+        size_t size = static_cast<size_t>(count) * clusterSize;
+#ifdef _WIN32
+        FlushViewOfFile(start, static_cast<SIZE_T>(size));
+        FlushFileBuffers(static_cast<HANDLE>(fileHandle));
+#else
+        // msync wants a page-aligned start
+        size_t misalignment = static_cast<size_t>(start - mappedImage) % static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        msync(start - misalignment, size + misalignment, MS_SYNC);
+#endif
+        return;
+    }
+
+    // writeChain writes straight to the file, so only the file itself needs syncing; the sync covers the whole file,
+    // as neither the stream nor fdatasync can be limited to a range
+    syncFile();
+}
+
+void Virtual_Disk::syncFile()
+{
     Disk.flush();
-    
+#ifdef _WIN32
+    if (fileHandle != nullptr)
+        FlushFileBuffers(static_cast<HANDLE>(fileHandle));
+#else
+    if (fileDescriptor >= 0)
+        fdatasync(fileDescriptor);
+#endif
+}
+
+void Virtual_Disk::touch(CachedCluster& entry)
+{
+    lru.splice(lru.begin(), lru, entry.lruPosition);
 }
 
-vector<char> Virtual_Disk::readCluster(int clusterIndex)
+void Virtual_Disk::setUse(CachedCluster& entry, ClusterUse use)
 {
-    /*
-    Moves the file read pointer to the beginning of the specified cluster.
-    The cluster is 1024 bytes, and we move the pointer by multiplying the
-    cluster index by 1024 (the size of one cluster).
-    */
-    Disk.seekg(clusterIndex * 1024, ios::beg);
-    
+    bool fileData = (use == ClusterUse::FileData);
+    if (entry.fileData == fileData)
+        return;
+    entry.fileData = fileData;
+    if (fileData)
+        fileDataClusters++;
+    else
+        fileDataClusters--;
+}
 
-    // Create a vector to hold the 1024 bytes of data we will read from the disk
-    vector<char> bytes(1024);
+Virtual_Disk::CachedCluster& Virtual_Disk::insert(int clusterIndex, bool dirty, ClusterUse use)
+{
+    // Make room by evicting the least recently used cluster, writing it back if it is dirty; file data that has used up
+    // its share replaces the least recently used file data cluster instead. The victim's buffer is handed to the new
+    // entry so a full cache does not allocate cluster buffers
+    vector<char> buffer;
+    auto victimPosition = lru.end();
+    if (use == ClusterUse::FileData && fileDataClusters >= FILE_DATA_CAPACITY)
+    {
+        for (auto it = lru.rbegin(); it != lru.rend(); ++it)
+        {
+            if (cache[*it].fileData)
+            {
+                victimPosition = prev(it.base());
+                break;
+            }
+        }
+    }
+    else if (cache.size() >= CACHE_CAPACITY)
+        victimPosition = prev(lru.end());
 
-    /*
-    Reads the 1024 bytes of data starting from the current position of the read pointer
-    and fills the 'bytes' vector with the data.
-    */
-    Disk.read(bytes.data(), 1024);
+    if (victimPosition != lru.end())
+    {
+        int victim = *victimPosition;
+        CachedCluster& old = cache[victim];
+        if (old.dirty)
+        {
+            writeRunToFile(victim, 1, old.data.data());
+            writebacks++;
+        }
+        if (old.fileData)
+            fileDataClusters--;
+        buffer = move(old.data);
+        lru.erase(victimPosition);
+        cache.erase(victim);
+    }
+    buffer.resize(clusterSize);
 
-    // Check if the read operation was successful
-    
-    // Return the vector containing the data read from the cluster
-    return bytes;
+    lru.push_front(clusterIndex);
+    CachedCluster& entry = cache[clusterIndex];
+    entry.data = move(buffer);
+    entry.dirty = dirty;
+    entry.fileData = (use == ClusterUse::FileData);
+    if (entry.fileData)
+        fileDataClusters++;
+    entry.lruPosition = lru.begin();
+    return entry;
 }
 
 bool Virtual_Disk::isNew()
 {
+    // A mapped image has already been grown to full size, so use the size it had when opened
+    if (mode == DiskMode::Mapped)
+        return mappedWasNew;
+
     // Move the file pointer to the end of the file to determine its size
     Disk.seekg(0, ios::end);
 
-    // Get the current position of the read pointer, which represents the size of the file
-    int size = static_cast<int>(Disk.tellg());
+    // Get the current position of the read pointer, which represents the size of the file; images past 2 GiB need
+    // the full stream offset
+    streamoff size = Disk.tellg();
 
     // If the file size is zero, it means the disk is new (empty)
     return (size == 0);
@@ -75,7 +827,55 @@ bool Virtual_Disk::isNew()
 
 void Virtual_Disk::closeDisk()
 {
+    unmapDisk();
+
     if (Disk.is_open()) {
+        // Nothing may be left only in memory when the file is closed
+        sync();
         Disk.close();
     }
-}
\ No newline at end of file
+
+#ifdef _WIN32
+    if (fileHandle != nullptr) {
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+        fileHandle = nullptr;
+    }
+#else
+    if (mode == DiskMode::Async)
+        Async_IO::close();
+    if (fileDescriptor >= 0) {
+        close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+#endif
+    mode = DiskMode::Stream;
+    cache.clear();
+    lru.clear();
+    fileDataClusters = 0;
+}
+
+long long Virtual_Disk::getCacheHits()
+{
+    return hits;
+}
+
+long long Virtual_Disk::getCacheMisses()
+{
+    return misses;
+}
+
+long long Virtual_Disk::getCacheWritebacks()
+{
+    return writebacks;
+}
+
+long long Virtual_Disk::getClusterWrites()
+{
+    return clusterWrites;
+}
+
+void Virtual_Disk::printCacheStats()
+{
+    cout << "Cluster cache: " << cache.size() << "/" << CACHE_CAPACITY << " cached (" << fileDataClusters << " file data), "
+        << hits << " hits, " << misses << " misses, " << writebacks << " write-backs" << endl;
+}
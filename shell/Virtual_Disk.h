@@ -1,31 +1,265 @@
 #pragma once
 #include <fstream>
 #include <iostream>
+#include <list>
+#include <map>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
+/** How the disk image is accessed: through a file stream with a write-back cache, mapped whole into memory,
+    or like Stream but with chain reads and writes batched through io_uring (Linux only). */
+enum class DiskMode
+{
+    Stream,
+    Mapped,
+    Async
+};
+
+/** What a cluster read or written through the cache holds: file system structures (FAT, directories, journal) or the
+    data of a file. */
+enum class ClusterUse
+{
+    Metadata,
+    FileData
+};
+
 /** Simulates a virtual disk with functions to read/write clusters and handle the disk file. */
 class Virtual_Disk
 {
 public:
-    /** Creates or opens a virtual disk file. If not exists, creates it. */
-    static void createOrOpenDisk(const string& path);
+    /** Maximum number of clusters kept in the write-back cache before the least recently used one is evicted. */
+    static const size_t CACHE_CAPACITY = 64;
+
+    /** Most clusters of file data the cache keeps; past it a file data cluster replaces the least recently used one, so
+        streaming a large file recycles a few slots instead of evicting the directories and FAT around it. */
+    static const size_t FILE_DATA_CAPACITY = CACHE_CAPACITY / 4;
+
+    /** Geometry of a volume created without explicit settings, and of images written before geometry was recorded: 1024 clusters of 1024 bytes. */
+    static const int DEFAULT_CLUSTER_SIZE = 1024;
+    static const int DEFAULT_CLUSTER_COUNT = 1024;
+
+    /** Limits on the geometry: the cluster size is a power of two in [MIN_CLUSTER_SIZE, MAX_CLUSTER_SIZE]; the count is in [MIN_CLUSTER_COUNT, MAX_CLUSTER_COUNT]. */
+    static const int MIN_CLUSTER_SIZE = 512;
+    static const int MAX_CLUSTER_SIZE = 64 * 1024;
+    static const int MIN_CLUSTER_COUNT = 16;
+    static const int MAX_CLUSTER_COUNT = 16 * 1024 * 1024;
+
+    /** Returns true if the cluster size and count are within the limits above. */
+    static bool isValidGeometry(int clusterSize, int clusterCount);
+
+    /** Creates or opens a virtual disk file with the given geometry. If not exists, creates it. Falls back to Stream if the image
+        cannot be mapped or io_uring is unavailable. */
+    static void createOrOpenDisk(const string& path, DiskMode mode = DiskMode::Stream,
+        int clusterSize = DEFAULT_CLUSTER_SIZE, int clusterCount = DEFAULT_CLUSTER_COUNT);
+
+    /** Reads the first out.size() bytes of the image at path without opening it as the disk; returns how many bytes it got (0 if there is no file). */
+    static size_t readHeader(const string& path, span<char> out);
+
+    /** Returns the mode the disk was actually opened in. */
+    static DiskMode getMode();
+
+    /** Geometry of the open disk: bytes per cluster, number of clusters, and the image size in bytes. */
+    static int getClusterSize();
+    static int getClusterCount();
+    static long long getDiskSize();
+
+    /** Copies one cluster from the caller's buffer into the cache (or the mapping); it reaches the disk file on eviction or sync(). */
+    static void writeCluster(span<const char> cluster, int clusterIndex, ClusterUse use = ClusterUse::Metadata);
 
-    /** Writes a 1024-byte cluster to the virtual disk at the specified index. */
-    static void writeCluster(const vector<char>& cluster, int clusterIndex);
+    /** Reads one cluster into the caller's buffer, served from the cache when present (always from memory in Mapped mode). */
+    static void readCluster(int clusterIndex, span<char> out, ClusterUse use = ClusterUse::Metadata);
 
-    /** Reads a 1024-byte cluster from the virtual disk at the specified index. */
-    static vector<char> readCluster(int clusterIndex);
+    /** Reads the given clusters into out (one cluster size each), with a single read per run of consecutive cluster numbers. */
+    static void readClusters(span<const int> clusters, span<char> out);
+
+    /** Reads the FAT chain starting at firstCluster into out until the chain ends or out is full; returns the number of clusters read. */
+    static int readChain(int firstCluster, span<char> out);
+
+    /** Writes buffer across the given clusters (the last one zero-padded), with a single write per run of consecutive cluster numbers.
+        Inside a transaction use decides whether they are staged as metadata, for the journal, or as file data. */
+    static void writeChain(span<const int> clusters, span<const char> buffer, ClusterUse use = ClusterUse::Metadata);
+
+    /** Like writeChain, but compares each cluster with what the disk already holds and writes only the ones that differ;
+        returns the number of clusters written. */
+    static int writeChangedClusters(span<const int> clusters, span<const char> buffer, ClusterUse use = ClusterUse::Metadata);
+
+    /** Writes every dirty cached cluster back to the disk file and makes the file durable: the stream is flushed and
+        the file synced to stable storage (msync in Mapped mode). Does nothing while a transaction is open. */
+    static void sync();
+
+    /** Makes the count clusters from firstCluster durable after writeChain wrote them, leaving other dirty cached clusters
+        in the cache (in Mapped mode only the pages holding them are flushed). */
+    static void syncClusters(int firstCluster, int count);
+
+    /** Opens a transaction: from then on every write is staged in memory, reads see the staged data, and nothing reaches
+        the image until commitTransaction() or abortTransaction(). Returns false if one is already open. */
+    static bool beginTransaction();
+
+    /** Writes every staged cluster and syncs: first the clusters from firstDataCluster on, then the ones below it
+        (superblock and FAT), so the FAT never refers to data that is not on disk yet. Returns false if none is open. */
+    static bool commitTransaction(int firstDataCluster);
+
+    /** Drops every staged cluster, leaving the image as it was when the transaction began. Returns false if none is open. */
+    static bool abortTransaction();
+
+    /** Closes the transaction and hands its staged metadata clusters to the caller, who writes them (the journal
+        does). Staged file data is written home and synced here first, so metadata never reaches the disk ahead of the
+        data it refers to. The map is empty if none is open, and stays valid until releaseStaged(). */
+    static const map<int, vector<char>>& takeStaged();
+
+    /** Drops the clusters takeStaged() returned, keeping some of their buffers for the next transaction to stage into. */
+    static void releaseStaged();
+
+    static bool isTransactionOpen();
 
     /** Checks if the virtual disk file is new (empty). */
     static bool isNew();
 
     static void closeDisk();
 
-    
+    /** Cache statistics: reads served from memory, reads that went to the file, and dirty clusters written back. */
+    static long long getCacheHits();
+    static long long getCacheMisses();
+    static long long getCacheWritebacks();
+
+    /** Number of clusters written so far through writeCluster, writeChain and writeChangedClusters (clusters the latter skips are not counted). */
+    static long long getClusterWrites();
+
+    /** Prints the cache statistics for debugging purposes. */
+    static void printCacheStats();
 
 private:
+    /** One cached cluster: its bytes, whether they differ from the file, whether they are file data, and its position in
+        the LRU list. */
+    struct CachedCluster
+    {
+        vector<char> data;
+        bool dirty;
+        bool fileData;
+        list<int>::iterator lruPosition;
+    };
+
     /** File stream for the virtual disk, opened in read/write binary mode. */
     static fstream Disk;
+
+    static DiskMode mode;
+
+    /** Geometry of the open disk. */
+    static int clusterSize;
+    static int clusterCount;
+
+    /** Base address of the mapped image in Mapped mode, whether it changed since the last sync, and whether it was empty when opened. */
+    static char* mappedImage;
+    static bool mappedDirty;
+    static bool mappedWasNew;
+
+    /** Operating system handles of the image: they back the mapping in Mapped mode, and in Stream and Async mode they
+        are what syncFile() syncs (and, on POSIX, the io_uring descriptor in Async mode). */
+#ifdef _WIN32
+    static void* fileHandle;
+    static void* mappingHandle;
+#else
+    static int fileDescriptor;
+#endif
+
+    /** A run queued on the ring in Async mode: out is set for reads, data and size for writes. */
+    struct PendingRun
+    {
+        int firstCluster;
+        int count;
+        char* out;
+        const char* data;
+        size_t size;
+    };
+    static vector<PendingRun> pendingRuns;
+
+    /** Whether a transaction is open, and the clusters it wrote by index (ordered, so the commit writes them in order):
+        file data apart from the metadata, because only the metadata goes through the journal. */
+    static bool transactionOpen;
+    static map<int, vector<char>> staged;
+    static map<int, vector<char>> stagedFileData;
+
+    /** The clusters handed out by takeStaged(), and map nodes with a cluster buffer each, recycled by stage() so a
+        transaction of a few clusters allocates nothing; at most SPARE_STAGED_CAPACITY are kept. */
+    static map<int, vector<char>> taken;
+    static vector<map<int, vector<char>>::node_type> spareStaged;
+    static const size_t SPARE_STAGED_CAPACITY = 64;
+
+    /** Empties clusters, moving its nodes to spareStaged while there is room. */
+    static void recycleStaged(map<int, vector<char>>& clusters);
+
+    /** Stages size bytes of data (zero-padded to whole clusters) for count clusters from firstCluster, with the
+        staged file data or metadata according to use. */
+    static void stage(int firstCluster, int count, const char* data, size_t size, ClusterUse use);
+
+    /** Writes the clusters of clusters in [from, to), which hold use, with one write per run of consecutive cluster
+        numbers. */
+    static void writeStaged(const map<int, vector<char>>& clusters, int from, int to, ClusterUse use);
+
+    /** Reused buffer that writeChangedClusters() reads the current cluster contents into. */
+    static vector<char> compareBuffer;
+
+    /** Opens the image and maps getDiskSize() bytes of it; returns false (and leaves nothing open) on failure. */
+    static bool mapDisk(const string& path);
+
+    /** Flushes and releases the mapping. */
+    static void unmapDisk();
+
+    /** Cached clusters by index, and their recency order (front is most recently used). */
+    static unordered_map<int, CachedCluster> cache;
+    static list<int> lru;
+
+    /** Number of cached clusters holding file data. */
+    static size_t fileDataClusters;
+
+    /** Records what a cached cluster holds now; a freed cluster may be reused for the other kind. */
+    static void setUse(CachedCluster& entry, ClusterUse use);
+
+    static long long hits;
+    static long long misses;
+    static long long writebacks;
+    static long long clusterWrites;
+
+    /** Reads or writes count consecutive clusters starting at firstCluster straight from/to the disk file, in one call.
+        Clusters past the end of the file read as zeros. */
+    static void readRunFromFile(int firstCluster, int count, char* out);
+    static void writeRunToFile(int firstCluster, int count, const char* data);
+
+    /** Flushes the stream and syncs the file to stable storage in Stream and Async mode; a stream flush alone only
+        hands the data to the operating system. */
+    static void syncFile();
+
+    /** Writes size bytes of data followed by zeros over count consecutive clusters of the disk file. */
+    static void writePaddedRunToFile(int firstCluster, int count, const char* data, size_t size);
+
+    /** Copies clusters that are dirty in the cache, or staged by an open transaction, over the matching parts of out. */
+    static void overlayDirty(int firstCluster, int count, char* out);
+
+    /** Reads the chain starting at firstCluster into out through readRun, without completing the batch. */
+    static int queueChain(int firstCluster, span<char> out);
+
+    /** Bracket a group of run reads/writes; in Async mode finishBatch() submits them, waits, and falls back on failure. */
+    static void beginBatch();
+    static void finishBatch();
+
+    /** Reads count consecutive clusters into out through the active backend; dirty cached clusters win over the file. */
+    static void readRun(int firstCluster, int count, char* out);
+
+    /** Writes size bytes of data over count consecutive clusters, zero-padding the rest, and refreshes cached copies;
+        inside a transaction they are staged according to use. */
+    static void writeRun(int firstCluster, int count, const char* data, size_t size, ClusterUse use);
+
+    /** Returns how many cluster numbers starting at position start are consecutive. */
+    static int runLength(span<const int> clusters, size_t start);
+
+    /** Marks a cached cluster as most recently used. */
+    static void touch(CachedCluster& entry);
+
+    /** Adds a cache entry for a cluster, evicting (and writing back) the least recently used one when full, or the least
+        recently used file data cluster when file data is at FILE_DATA_CAPACITY. The entry's buffer is reused from the
+        evicted one when possible; the caller fills it. */
+    static CachedCluster& insert(int clusterIndex, bool dirty, ClusterUse use);
 };